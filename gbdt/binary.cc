@@ -0,0 +1,136 @@
+#include "binary.h"
+#include "flat-trees.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char BINARY_MODEL_MAGIC[8] = "GBDTBIN";
+
+static uint64_t fnv1a(uint64_t hash, const void * data, size_t size)
+{
+    const unsigned char * p = (const unsigned char *)data;
+    for (size_t i=0; i<size; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t get_checksum(const BinaryModelHeader& header, const void * memory, size_t size)
+{
+    BinaryModelHeader h = header;
+    h.checksum = 0;
+    uint64_t hash = fnv1a(14695981039346656037ULL, &h, sizeof(h));
+    return fnv1a(hash, memory, size);
+}
+
+int save_binary(FILE * fp, const FlatTrees& flat_trees)
+{
+    BinaryModelHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MODEL_MAGIC, sizeof(header.magic));
+    header.version = BinaryModelHeader::kVersion;
+    header.header_size = sizeof(header);
+    header.tree_size = flat_trees.tree_size();
+    header.node_size = flat_trees.node_size();
+    header.y0 = flat_trees.y0();
+
+    size_t size = FlatTrees::get_memory_size(flat_trees.tree_size(), flat_trees.node_size());
+    header.checksum = get_checksum(header, flat_trees.memory(), size);
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1
+            || (size && fwrite(flat_trees.memory(), size, 1, fp) != 1))
+    {
+        fprintf(stderr, "write binary model failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int BinaryModel::load(const char * filename, FlatTrees * flat_trees)
+{
+    clear();
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+        fprintf(stderr, "open \"%s\" failed\n", filename);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(BinaryModelHeader))
+    {
+        fprintf(stderr, "\"%s\" is not a binary model\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void * memory = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap \"%s\" failed\n", filename);
+        return -1;
+    }
+    memory_ = memory;
+    size_ = size;
+
+    const BinaryModelHeader& header = *(const BinaryModelHeader *)memory_;
+    if (memcmp(header.magic, BINARY_MODEL_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "\"%s\" is not a binary model\n", filename);
+        clear();
+        return -1;
+    }
+
+    if (header.version != BinaryModelHeader::kVersion
+            || header.header_size != sizeof(BinaryModelHeader))
+    {
+        fprintf(stderr, "unsupported binary model version: %u\n", (unsigned)header.version);
+        clear();
+        return -1;
+    }
+
+    // a model without trees has no nodes either
+    if (header.node_size > 0xffffffffULL || header.tree_size > header.node_size
+            || (header.tree_size == 0 && header.node_size != 0))
+    {
+        fprintf(stderr, "invalid binary model size\n");
+        clear();
+        return -1;
+    }
+
+    size_t memory_size = FlatTrees::get_memory_size(header.tree_size, header.node_size);
+    const char * arrays = (const char *)memory_ + header.header_size;
+    if (size - header.header_size != memory_size)
+    {
+        fprintf(stderr, "invalid binary model size\n");
+        clear();
+        return -1;
+    }
+
+    if (get_checksum(header, arrays, memory_size) != header.checksum)
+    {
+        fprintf(stderr, "binary model checksum mismatch\n");
+        clear();
+        return -1;
+    }
+
+    flat_trees->attach(header.y0, arrays, header.tree_size, header.node_size);
+    return 0;
+}
+
+void BinaryModel::clear()
+{
+    if (memory_)
+    {
+        munmap(memory_, size_);
+        memory_ = 0;
+        size_ = 0;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef GBDT_BINARY_H
+#define GBDT_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+class FlatTrees;
+
+// Binary model file: a BinaryModelHeader followed by FlatTrees::memory(),
+// both in native byte order, so that the arrays can be used in place.
+struct BinaryModelHeader
+{
+    enum
+    {
+        kVersion = 1,
+    };
+
+    // "GBDTBIN" and '\0'
+    char magic[8];
+    uint32_t version;
+    // sizeof(BinaryModelHeader), the arrays start right after it
+    uint32_t header_size;
+    uint64_t tree_size;
+    uint64_t node_size;
+    double y0;
+    // FNV-1a of the header with checksum being 0 and the arrays
+    uint64_t checksum;
+};
+
+int save_binary(FILE * fp, const FlatTrees& flat_trees);
+
+// a read-only memory mapped binary model
+class BinaryModel
+{
+private:
+    void * memory_;
+    size_t size_;
+    BinaryModel(const BinaryModel&);
+    BinaryModel& operator=(const BinaryModel&);
+
+public:
+    BinaryModel() : memory_(0), size_(0) {}
+    ~BinaryModel() {clear();}
+
+    // map 'filename', check it and attach 'flat_trees' to the mapped arrays,
+    // 'flat_trees' is valid until this object is cleared
+    int load(const char * filename, FlatTrees * flat_trees);
+    void clear();
+};
+
+#endif// GBDT_BINARY_H
@@ -0,0 +1,248 @@
+#include "flat-trees.h"
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+# define ENABLE_X86_SIMD
+# include <immintrin.h>
+#endif
+
+// All implementations walk tree by tree, and add a tree's y to a row
+// in the same order as 'predict', so they give the same results.
+
+FlatTrees::kSimd FlatTrees::get_simd()
+{
+#if defined ENABLE_X86_SIMD
+    static const kSimd simd = __builtin_cpu_supports("avx512f") ? kSimd_AVX512
+        : __builtin_cpu_supports("avx2") ? kSimd_AVX2
+        : kSimd_None;
+    return simd;
+#else
+    return kSimd_None;
+#endif
+}
+
+void FlatTrees::predict_batch(
+    const double * rows,
+    size_t n,
+    size_t stride,
+    double * out,
+    kSimd simd) const
+{
+    // SIMD versions only compare numerical x
+    // and use 32-bit offsets in a block of rows.
+    // Without trees, the scalar version writes y0.
+    if (has_category_ || stride > (1U << 24) || empty())
+        simd = kSimd_None;
+
+    switch (simd)
+    {
+#if defined ENABLE_X86_SIMD
+    case kSimd_AVX512:
+        predict_batch_avx512(rows, n, stride, out);
+        break;
+    case kSimd_AVX2:
+        predict_batch_avx2(rows, n, stride, out);
+        break;
+#endif
+    default:
+        predict_batch_scalar(rows, n, stride, out);
+        break;
+    }
+}
+
+void FlatTrees::predict_batch_scalar(
+    const double * rows,
+    size_t n,
+    size_t stride,
+    double * out) const
+{
+    // rows of a block stay in cache while all trees walk them
+    static const size_t kBlockRows = 64;
+
+    for (size_t block=0; block<n; block+=kBlockRows)
+    {
+        size_t block_end = block + kBlockRows < n ? block + kBlockRows : n;
+        for (size_t i=block; i<block_end; i++)
+            out[i] = y0_;
+
+        for (size_t tree=0; tree<tree_size_; tree++)
+        {
+            uint32_t root = roots_[tree];
+            for (size_t i=block; i<block_end; i++)
+            {
+                const double * X = rows + i * stride;
+                uint32_t node = root;
+                for (;;)
+                {
+                    uint8_t type = type_[node];
+                    if (type == kLeaf)
+                        break;
+
+                    double x = X[x_index_[node]];
+                    bool lies_left = (type == kXType_Numerical)
+                        ? (x <= value_[node].d())
+                        : ((int)x == value_[node].i());
+                    node = lies_left ? node + 1 : right_[node];
+                }
+                out[i] += value_[node].d();
+            }
+        }
+    }
+}
+
+#if defined ENABLE_X86_SIMD
+// A SIMD lane walks a row down a tree, and stops moving once it reaches
+// a leaf, whose right child is itself. Several groups of lanes are
+// interleaved to hide the latency of gathers.
+static const size_t kAVX2Groups = 4;
+static const size_t kAVX512Groups = 4;
+
+__attribute__((target("avx2")))
+void FlatTrees::predict_batch_avx2(
+    const double * rows,
+    size_t n,
+    size_t stride,
+    double * out) const
+{
+    const int * x_index = (const int *)x_index_;
+    const int * right = (const int *)right_;
+    const double * value = (const double *)value_;
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i lane_offsets = _mm_setr_epi32(0, (int)stride, (int)stride * 2, (int)stride * 3);
+    // picks the low 32 bits of 4 64-bit masks
+    const __m256i pack_mask = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    // masked gathers of all lanes into zeros, as the unmasked ones gather
+    // into an undefined register, which -Wmaybe-uninitialized reports
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    const size_t block_rows = 4 * kAVX2Groups;
+
+    size_t block_end = n / block_rows * block_rows;
+    for (size_t i=0; i<block_end; i+=block_rows)
+    {
+        const double * X[kAVX2Groups];
+        __m256d y[kAVX2Groups];
+        for (size_t g=0; g<kAVX2Groups; g++)
+        {
+            X[g] = rows + (i + g * 4) * stride;
+            y[g] = _mm256_set1_pd(y0_);
+        }
+
+        for (size_t tree=0; tree<tree_size_; tree++)
+        {
+            __m128i node[kAVX2Groups];
+            for (size_t g=0; g<kAVX2Groups; g++)
+                node[g] = _mm_set1_epi32((int)roots_[tree]);
+
+            for (;;)
+            {
+                int moving = 0;
+                for (size_t g=0; g<kAVX2Groups; g++)
+                {
+                    __m128i node_right = _mm_i32gather_epi32(right, node[g], 4);
+                    __m128i leaf = _mm_cmpeq_epi32(node_right, node[g]);
+                    moving |= _mm_movemask_epi8(leaf) ^ 0xFFFF;
+
+                    __m128i index = _mm_add_epi32(_mm_i32gather_epi32(x_index, node[g], 4), lane_offsets);
+                    __m256d x = _mm256_mask_i32gather_pd(zero, X[g], index, all, 8);
+                    __m256d split = _mm256_mask_i32gather_pd(zero, value, node[g], all, 8);
+                    __m256i left64 = _mm256_castpd_si256(_mm256_cmp_pd(x, split, _CMP_LE_OQ));
+                    __m128i left = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(left64, pack_mask));
+
+                    __m128i next = _mm_blendv_epi8(node_right, _mm_add_epi32(node[g], one), left);
+                    node[g] = _mm_blendv_epi8(next, node[g], leaf);
+                }
+                if (moving == 0)
+                    break;
+            }
+
+            for (size_t g=0; g<kAVX2Groups; g++)
+                y[g] = _mm256_add_pd(y[g], _mm256_mask_i32gather_pd(zero, value, node[g], all, 8));
+        }
+
+        for (size_t g=0; g<kAVX2Groups; g++)
+            _mm256_storeu_pd(out + i + g * 4, y[g]);
+    }
+
+    if (block_end != n)
+        predict_batch_scalar(rows + block_end * stride, n - block_end, stride, out + block_end);
+}
+
+// the low 8 32-bit lanes of 'v'; _mm512_castsi512_si256 warns as the
+// unmasked gathers do, this compiles to no instruction as well
+__attribute__((target("avx512f")))
+static inline __m256i low_half(__m512i v)
+{
+    return _mm512_maskz_extracti64x4_epi64(0xF, v, 0);
+}
+
+// 8 lanes are used in the low half of 16 32-bit lanes.
+__attribute__((target("avx512f")))
+void FlatTrees::predict_batch_avx512(
+    const double * rows,
+    size_t n,
+    size_t stride,
+    double * out) const
+{
+    const int * x_index = (const int *)x_index_;
+    const int * right = (const int *)right_;
+    const double * value = (const double *)value_;
+    const __mmask16 lanes = 0x00FF;
+    // see predict_batch_avx2
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i lane_offsets = _mm512_mullo_epi32(
+        _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 0, 0, 0, 0, 0, 0, 0, 0),
+        _mm512_set1_epi32((int)stride));
+    const size_t block_rows = 8 * kAVX512Groups;
+
+    size_t block_end = n / block_rows * block_rows;
+    for (size_t i=0; i<block_end; i+=block_rows)
+    {
+        const double * X[kAVX512Groups];
+        __m512d y[kAVX512Groups];
+        for (size_t g=0; g<kAVX512Groups; g++)
+        {
+            X[g] = rows + (i + g * 8) * stride;
+            y[g] = _mm512_set1_pd(y0_);
+        }
+
+        for (size_t tree=0; tree<tree_size_; tree++)
+        {
+            __m512i node[kAVX512Groups];
+            for (size_t g=0; g<kAVX512Groups; g++)
+                node[g] = _mm512_set1_epi32((int)roots_[tree]);
+
+            for (;;)
+            {
+                __mmask16 moving = 0;
+                for (size_t g=0; g<kAVX512Groups; g++)
+                {
+                    __m512i node_right = _mm512_mask_i32gather_epi32(node[g], lanes, node[g], right, 4);
+                    __mmask16 leaf = _mm512_mask_cmpeq_epi32_mask(lanes, node_right, node[g]);
+                    moving |= leaf ^ lanes;
+
+                    __m512i index = _mm512_add_epi32(
+                        _mm512_mask_i32gather_epi32(node[g], lanes, node[g], x_index, 4), lane_offsets);
+                    __m512d x = _mm512_mask_i32gather_pd(zero, (__mmask8)lanes, low_half(index), X[g], 8);
+                    __m512d split = _mm512_mask_i32gather_pd(zero, (__mmask8)lanes, low_half(node[g]), value, 8);
+                    __mmask16 left = (__mmask16)_mm512_cmp_pd_mask(x, split, _CMP_LE_OQ);
+
+                    __m512i next = _mm512_mask_blend_epi32(left, node_right, _mm512_add_epi32(node[g], one));
+                    node[g] = _mm512_mask_blend_epi32(leaf, next, node[g]);
+                }
+                if (moving == 0)
+                    break;
+            }
+
+            for (size_t g=0; g<kAVX512Groups; g++)
+                y[g] = _mm512_add_pd(y[g], _mm512_mask_i32gather_pd(zero, (__mmask8)lanes, low_half(node[g]), value, 8));
+        }
+
+        for (size_t g=0; g<kAVX512Groups; g++)
+            _mm512_storeu_pd(out + i + g * 8, y[g]);
+    }
+
+    if (block_end != n)
+        predict_batch_scalar(rows + block_end * stride, n - block_end, stride, out + block_end);
+}
+#endif
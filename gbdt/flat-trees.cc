@@ -0,0 +1,130 @@
+#include "flat-trees.h"
+#include "node.h"
+#include <assert.h>
+
+// Arrays are laid out as value, roots, x_index, right and type,
+// so that every array is aligned to its element size.
+size_t FlatTrees::get_memory_size(size_t tree_size, size_t node_size)
+{
+    size_t size = node_size * sizeof(CompoundValue)
+        + tree_size * sizeof(uint32_t)
+        + node_size * sizeof(uint32_t) * 2
+        + node_size * sizeof(uint8_t);
+    // round up to 8 bytes
+    return (size + 7) / 8 * 8;
+}
+
+void FlatTrees::set_arrays(const void * memory)
+{
+    const char * p = (const char *)memory;
+    value_ = (const CompoundValue *)p;
+    p += node_size_ * sizeof(CompoundValue);
+    roots_ = (const uint32_t *)p;
+    p += tree_size_ * sizeof(uint32_t);
+    x_index_ = (const uint32_t *)p;
+    p += node_size_ * sizeof(uint32_t);
+    right_ = (const uint32_t *)p;
+    p += node_size_ * sizeof(uint32_t);
+    type_ = (const uint8_t *)p;
+}
+
+static bool get_has_category(const uint8_t * type, size_t node_size)
+{
+    for (size_t i=0; i<node_size; i++)
+        if (type[i] == kXType_Category)
+            return true;
+    return false;
+}
+
+static size_t get_node_size(const TreeNodeBase * node)
+{
+    if (node->is_leaf())
+        return 1;
+    return 1 + get_node_size(node->left()) + get_node_size(node->right());
+}
+
+struct FlatTreesBuilder
+{
+    CompoundValue * value;
+    uint32_t * x_index;
+    uint32_t * right;
+    uint8_t * type;
+    uint32_t next;
+
+    void add(const TreeNodeBase * node)
+    {
+        uint32_t i = next++;
+        if (node->is_leaf())
+        {
+            value[i].d() = node->y();
+            x_index[i] = 0;
+            right[i] = i;
+            type[i] = FlatTrees::kLeaf;
+            return;
+        }
+
+        value[i] = node->split_x_value();
+        x_index[i] = (uint32_t)node->split_x_index();
+        type[i] = (uint8_t)node->split_x_type();
+        add(node->left());
+        right[i] = next;
+        add(node->right());
+    }
+};
+
+void FlatTrees::build(double y0, const std::vector<TreeNodeBase *>& trees)
+{
+    clear();
+    // a model without trees predicts y0
+    y0_ = y0;
+    if (trees.empty())
+        return;
+
+    size_t node_size = 0;
+    for (size_t i=0, s=trees.size(); i<s; i++)
+        node_size += get_node_size(trees[i]);
+
+    tree_size_ = trees.size();
+    node_size_ = node_size;
+    storage_.assign(get_memory_size(tree_size_, node_size_) / 8, 0);
+    set_arrays(&storage_[0]);
+
+    FlatTreesBuilder builder;
+    builder.value = (CompoundValue *)value_;
+    builder.x_index = (uint32_t *)x_index_;
+    builder.right = (uint32_t *)right_;
+    builder.type = (uint8_t *)type_;
+    builder.next = 0;
+    for (size_t i=0, s=trees.size(); i<s; i++)
+    {
+        ((uint32_t *)roots_)[i] = builder.next;
+        builder.add(trees[i]);
+    }
+    assert(builder.next == node_size_);
+    has_category_ = get_has_category(type_, node_size_);
+}
+
+void FlatTrees::attach(double y0, const void * memory, size_t tree_size, size_t node_size)
+{
+    assert(((uintptr_t)memory & 7) == 0);
+    storage_.clear();
+    y0_ = y0;
+    tree_size_ = tree_size;
+    node_size_ = node_size;
+    set_arrays(memory);
+    has_category_ = get_has_category(type_, node_size_);
+}
+
+void FlatTrees::clear()
+{
+    storage_.clear();
+    y0_ = 0.0;
+    tree_size_ = 0;
+    node_size_ = 0;
+    value_ = 0;
+    roots_ = 0;
+    x_index_ = 0;
+    right_ = 0;
+    type_ = 0;
+    has_category_ = false;
+}
@@ -0,0 +1,125 @@
+#ifndef GBDT_FLAT_TREES_H
+#define GBDT_FLAT_TREES_H
+
+#include "sample.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class TreeNodeBase;
+
+// Trees packed for prediction.
+// Nodes of all trees are stored in pre-order as a struct of arrays,
+// so the left child of an inner node i is always node i+1,
+// and the right child of a leaf node i is itself.
+class FlatTrees
+{
+public:
+    // node type, the others are kXType
+    enum
+    {
+        kLeaf = 2,
+    };
+
+    // instruction sets of predict_batch
+    enum kSimd
+    {
+        kSimd_None = 0,
+        kSimd_AVX2 = 1,
+        kSimd_AVX512 = 2,
+    };
+
+private:
+    // owned memory of all arrays, empty if they point to external memory
+    std::vector<uint64_t> storage_;
+    double y0_;
+    size_t tree_size_;
+    size_t node_size_;
+    // inner node: split value; leaf node: predicted y
+    const CompoundValue * value_;
+    // roots_[i] is the root node of the ith tree
+    const uint32_t * roots_;
+    // inner node only
+    const uint32_t * x_index_;
+    const uint32_t * right_;
+    // kXType or kLeaf
+    const uint8_t * type_;
+    // whether any inner node splits a category feature
+    bool has_category_;
+
+    FlatTrees(const FlatTrees&);
+    FlatTrees& operator=(const FlatTrees&);
+    void set_arrays(const void * memory);
+    void predict_batch_scalar(const double * rows, size_t n, size_t stride, double * out) const;
+    void predict_batch_avx2(const double * rows, size_t n, size_t stride, double * out) const;
+    void predict_batch_avx512(const double * rows, size_t n, size_t stride, double * out) const;
+
+public:
+    FlatTrees() {clear();}
+
+    bool empty() const {return tree_size_ == 0;}
+    double y0() const {return y0_;}
+    size_t tree_size() const {return tree_size_;}
+    size_t node_size() const {return node_size_;}
+    const CompoundValue * value() const {return value_;}
+    const uint32_t * roots() const {return roots_;}
+    const uint32_t * x_index() const {return x_index_;}
+    const uint32_t * right() const {return right_;}
+    const uint8_t * type() const {return type_;}
+
+    // bytes of memory holding all arrays
+    static size_t get_memory_size(size_t tree_size, size_t node_size);
+    const void * memory() const {return value_;}
+
+    void build(double y0, const std::vector<TreeNodeBase *>& trees);
+    // use arrays in external memory laid out as 'memory()',
+    // it must be 8-byte aligned and outlive this object
+    void attach(double y0, const void * memory, size_t tree_size, size_t node_size);
+    void clear();
+
+    // y0 plus all trees' predicted y
+    double predict(const CompoundValueVector& X) const
+    {
+        return predict(&X[0]);
+    }
+
+    double predict(const CompoundValue * X) const
+    {
+        double y = y0_;
+        for (size_t i=0; i<tree_size_; i++)
+            y += predict_tree(i, X);
+        return y;
+    }
+
+    // the best instruction set supported by this CPU
+    static kSimd get_simd();
+
+    // predict 'n' rows of numerical x,
+    // row i starts at rows[i * stride] and its predicted y is written to out[i].
+    // Category x are given as doubles of their integer values.
+    // Results are the same as 'predict' whatever 'simd' is.
+    void predict_batch(const double * rows, size_t n, size_t stride, double * out) const
+    {
+        predict_batch(rows, n, stride, out, get_simd());
+    }
+    void predict_batch(const double * rows, size_t n, size_t stride, double * out, kSimd simd) const;
+
+    double predict_tree(size_t tree, const CompoundValue * X) const
+    {
+        uint32_t node = roots_[tree];
+        for (;;)
+        {
+            uint8_t type = type_[node];
+            if (type == kLeaf)
+                return value_[node].d();
+
+            const CompoundValue& x = X[x_index_[node]];
+            bool lies_left = (type == kXType_Numerical)
+                ? (x.d() <= value_[node].d())
+                : (x.i() == value_[node].i());
+            node = lies_left ? node + 1 : right_[node];
+        }
+    }
+};
+
+#endif// GBDT_FLAT_TREES_H
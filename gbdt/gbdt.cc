@@ -1,19 +1,20 @@
 #include "gbdt.h"
 #include "json.h"
 #include "node.h"
+#include "thread-pool.h"
 #include <assert.h>
 #include <math.h>
 #include <algorithm>
 
-static double weighted_mean_y(const XYSet& full_set)
+// of the first 'size' samples
+static double weighted_mean_y(const XYSet& full_set, size_t size)
 {
     double total_y  = 0.0;
     double total_weight = 0.0;
-    for (size_t i=0, s=full_set.size(); i<s; i++)
+    for (size_t i=0; i<size; i++)
     {
-        const XY& xy = full_set.get(i);
-        double weight = xy.weight();
-        total_y += xy.y() * weight;
+        double weight = full_set.weight(i);
+        total_y += full_set.y(i) * weight;
         total_weight += weight;
     }
     return total_y / total_weight;
@@ -37,24 +38,24 @@ public:
 
     virtual void initial_fx(
         const XYSet& full_set,
+        size_t size,
         std::vector<double> * full_fx,
         double * y0) const
     {
-        *y0 = weighted_mean_y(full_set);
-        full_fx->assign(full_set.size(), *y0);
+        *y0 = weighted_mean_y(full_set, size);
+        full_fx->assign(size, *y0);
     }
 
     virtual double total_loss(
         const XYSet& full_set,
         const std::vector<double>& full_fx) const
     {
-        assert(full_set.size() == full_fx.size());
+        assert(full_set.size() >= full_fx.size());
         double loss = 0.0;
-        for (size_t i=0, s=full_set.size(); i<s; i++)
+        for (size_t i=0, s=full_fx.size(); i<s; i++)
         {
-            const XY& xy = full_set.get(i);
-            double residual = full_set.get(i).y() - full_fx[i];
-            loss += (residual * residual * xy.weight());
+            double residual = full_set.y(i) - full_fx[i];
+            loss += (residual * residual * full_set.weight(i));
         }
         return loss;
     }
@@ -65,8 +66,12 @@ protected:
         assert(response_.empty());
         const XYSetRef& xy_set = set();
         assert(xy_set.size() == fx.size());
-        for (size_t i=0, s=fx.size(); i<s; i++)
-            response_.push_back((xy_set.get(i).y() - fx[i]));
+        response_.resize(fx.size());
+        parallel_for_range(fx.size(), [&](size_t begin, size_t end)
+        {
+            for (size_t i=begin; i<end; i++)
+                response_[i] = xy_set.y(i) - fx[i];
+        });
     }
 
     virtual void update_predicted_y() {}
@@ -121,13 +126,12 @@ private:
         return (*xw)[k].x;
     }
 
-    static double weighted_median_y(const XYSet& full_set)
+    static double weighted_median_y(const XYSet& full_set, size_t size)
     {
         std::vector<XW> xw;
-        for (size_t i=0, s=full_set.size(); i<s; i++)
+        for (size_t i=0; i<size; i++)
         {
-            const XY& xy = full_set.get(i);
-            xw.push_back(XW(xy.y(), xy.weight()));
+            xw.push_back(XW(full_set.y(i), full_set.weight(i)));
         }
         return weighted_median(&xw);
     }
@@ -143,24 +147,23 @@ public:
         return new LADLossNode(param, level);
     }
 
-    virtual void initial_fx(const XYSet& full_set,
+    virtual void initial_fx(const XYSet& full_set, size_t size,
         std::vector<double> * full_fx, double * y0) const
     {
-        *y0 = weighted_median_y(full_set);
-        full_fx->assign(full_set.size(), *y0);
+        *y0 = weighted_median_y(full_set, size);
+        full_fx->assign(size, *y0);
     }
 
     virtual double total_loss(
         const XYSet& full_set,
         const std::vector<double>& full_fx) const
     {
-        assert(full_set.size() == full_fx.size());
+        assert(full_set.size() >= full_fx.size());
         double loss = 0.0;
-        for (size_t i=0, s=full_set.size(); i<s; i++)
+        for (size_t i=0, s=full_fx.size(); i<s; i++)
         {
-            const XY& xy = full_set.get(i);
-            double residual = full_set.get(i).y() - full_fx[i];
-            loss += fabs(residual) * xy.weight();
+            double residual = full_set.y(i) - full_fx[i];
+            loss += fabs(residual) * full_set.weight(i);
         }
         return loss;
     }
@@ -171,8 +174,12 @@ protected:
         assert(response_.empty());
         const XYSetRef& xy_set = set();
         assert(xy_set.size() == fx.size());
-        for (size_t i=0, s=fx.size(); i<s; i++)
-            response_.push_back(sign((xy_set.get(i).y() - fx[i])));
+        response_.resize(fx.size());
+        parallel_for_range(fx.size(), [&](size_t begin, size_t end)
+        {
+            for (size_t i=begin; i<end; i++)
+                response_[i] = sign(xy_set.y(i) - fx[i]);
+        });
     }
 
     virtual void update_predicted_y()
@@ -187,8 +194,7 @@ protected:
         std::vector<XW> response_weight;
         for (size_t i=0, s=xy_set.size(); i<s; i++)
         {
-            const XY& xy = xy_set.get(i);
-            response_weight.push_back(XW(response_[i], xy.weight()));
+            response_weight.push_back(XW(response_[i], xy_set.weight(i)));
         }
         // readjust leaf values by the weighted median values
         y() = weighted_median(&response_weight);
@@ -211,24 +217,24 @@ public:
         return new LogisticLossNode(param, level);
     }
 
-    virtual void initial_fx(const XYSet& full_set,
+    virtual void initial_fx(const XYSet& full_set, size_t size,
         std::vector<double> * full_fx, double * y0) const
     {
-        double _mean_y = weighted_mean_y(full_set);
+        double _mean_y = weighted_mean_y(full_set, size);
         *y0 = 0.5 * log((1+_mean_y) / (1-_mean_y));
-        full_fx->assign(full_set.size(), *y0);
+        full_fx->assign(size, *y0);
     }
 
     virtual double total_loss(
         const XYSet& full_set,
         const std::vector<double>& full_fx) const
     {
-        assert(full_set.size() == full_fx.size());
+        assert(full_set.size() >= full_fx.size());
         double loss = 0.0;
-        for (size_t i=0, s=full_set.size(); i<s; i++)
+        for (size_t i=0, s=full_fx.size(); i<s; i++)
         {
-            const XY& xy = full_set.get(i);
-            loss += log(1 + exp(-2.0 * xy.y() * full_fx[i])) * xy.weight();
+            double y = full_set.y(i);
+            loss += log(1 + exp(-2.0 * y * full_fx[i])) * full_set.weight(i);
         }
         return loss;
     }
@@ -239,12 +245,15 @@ protected:
         assert(response_.empty());
         const XYSetRef& xy_set = set();
         assert(xy_set.size() == fx.size());
-        for (size_t i=0, s=fx.size(); i<s; i++)
+        response_.resize(fx.size());
+        parallel_for_range(fx.size(), [&](size_t begin, size_t end)
         {
-            double y = xy_set.get(i).y();
-            double response = 2.0 * y / (1.0 + exp(2 * y * fx[i]));
-            response_.push_back(response);
-        }
+            for (size_t i=begin; i<end; i++)
+            {
+                double y = xy_set.y(i);
+                response_[i] = 2.0 * y / (1.0 + exp(2 * y * fx[i]));
+            }
+        });
     }
 
     virtual void update_predicted_y()
@@ -259,8 +268,7 @@ protected:
         double numerator = 0.0, denominator = 0.0;
         for (size_t i=0, s=xy_set.size(); i<s; i++)
         {
-            const XY& xy = xy_set.get(i);
-            double weight = xy.weight();
+            double weight = xy_set.weight(i);
             double response = response_[i];
             double abs_response = fabs(response);
 
@@ -280,11 +288,17 @@ protected:
 /************************************************************************/
 double GBDTPredictor::predict(const CompoundValueVector& X) const
 {
-    assert(!trees_.empty());
-    double y = y0_;
-    for (size_t i=0, s=trees_.size(); i<s; i++)
-        y += trees_[i]->predict(X);
-    return y;
+    if (!quick_scorer_.empty())
+        return quick_scorer_.predict(X);
+    return flat_trees_.predict(X);
+}
+
+void GBDTPredictor::predict_batch(const double * rows, size_t n, size_t stride, double * out) const
+{
+    if (!quick_scorer_.empty())
+        quick_scorer_.predict_batch(rows, n, stride, out);
+    else
+        flat_trees_.predict_batch(rows, n, stride, out);
 }
 
 double GBDTPredictor::predict_logistic(const CompoundValueVector& X) const
@@ -297,28 +311,53 @@ void GBDTPredictor::clear()
     for (size_t i=0, s=trees_.size(); i<s; i++)
         delete trees_[i];
     trees_.clear();
+    flat_trees_.clear();
+    quick_scorer_.clear();
+    binary_model_.clear();
+}
+
+void GBDTPredictor::set_engine(kEngine engine)
+{
+    quick_scorer_.clear();
+    // without trees FlatTrees predicts y0 alone
+    if (engine == kEngine_QuickScorer && !flat_trees_.empty() && quick_scorer_.build(flat_trees_) == -1)
+        fprintf(stderr, "QuickScorer does not support this model, use FlatTrees instead\n");
 }
 
-GBDTTrainer::GBDTTrainer(const XYSet& set, const TreeParam& param)
-    : full_set_(set), param_(param), full_fx_()
+GBDTTrainer::GBDTTrainer(const XYSet& set, const TreeParam& param, size_t train_size)
+    : full_set_(set), param_(param), full_fx_(),
+    train_size_(train_size)
 {
+    TreeNodeBase * holder;
     if (param_.gbdt_loss == "lad")
     {
-        holder_ = new LADLossNode(param, 0);
+        holder = new LADLossNode(param, 0);
     }
     else if (param_.gbdt_loss == "logistic")
     {
-        holder_ = new LogisticLossNode(param, 0);
+        holder = new LogisticLossNode(param, 0);
+    }
+    else
+    {
+        holder = new LSLossNode(param, 0);
+    }
+
+    if (param_.num_threads > 1)
+    {
+        pool_ = new ThreadPool(param_.num_threads);
+        holder->pool() = pool_;
     }
     else
     {
-        holder_ = new LSLossNode(param, 0);
+        pool_ = 0;
     }
+    holder_ = holder;
 }
 
 GBDTTrainer::~GBDTTrainer()
 {
     delete holder_;
+    delete pool_;
 }
 
 double GBDTTrainer::total_loss() const
@@ -359,17 +398,28 @@ void GBDTTrainer::dump_feature_importance() const
         printf("feature %d importance: %lf\n", (int)i, loss_drop_vector[i] / total_drop);
 }
 
-void GBDTTrainer::train()
+int GBDTTrainer::train()
 {
     assert(trees_.empty());
 
-    holder_->initial_fx(full_set_, &full_fx_, &y0_);
+    if (param_.gbdt_histogram_bins && !x_values_limited(full_set_, param_.gbdt_histogram_bins))
+    {
+        fprintf(stderr, "x values are not limited to %d for histograms\n", (int)param_.gbdt_histogram_bins);
+        return -1;
+    }
+
+    // the set may be filled after construction
+    size_t train_size = full_set_.size();
+    if (train_size_ != 0 && train_size_ < train_size)
+        train_size = train_size_;
+    holder_->initial_fx(full_set_, train_size, &full_fx_, &y0_);
     if (param_.verbose)
         printf("total_loss=%lf\n", total_loss());
 
     for (size_t i=0; i<param_.tree_number; i++)
     {
-        printf("training tree No.%d... ", (int)i);
+        if (param_.verbose)
+            printf("training tree No.%d... ", (int)i);
         TreeNodeBase * tree = holder_->train(full_set_, param_, &full_fx_);
         trees_.push_back(tree);
         if (param_.verbose)
@@ -377,17 +427,44 @@ void GBDTTrainer::train()
             double _total_loss = total_loss();
             tree->total_loss() = _total_loss;
             printf("total_loss=%lf\n", _total_loss);
+            printf("OK\n");
         }
-        printf("OK\n");
     }
 
+    flat_trees_.build(y0_, trees_);
+
     if (param_.verbose)
         dump_feature_importance();
+    return 0;
+}
+
+int GBDTPredictor::load_json(FILE * fp, kEngine engine)
+{
+    clear();
+    // only the packed trees are kept for prediction
+    std::vector<TreeNodeBase *> trees;
+    if (::load_json(fp, &y0_, &trees) == -1)
+        return -1;
+    flat_trees_.build(y0_, trees);
+    for (size_t i=0, s=trees.size(); i<s; i++)
+        delete trees[i];
+    set_engine(engine);
+    return 0;
+}
+
+int GBDTPredictor::load_binary(const char * filename, kEngine engine)
+{
+    clear();
+    if (binary_model_.load(filename, &flat_trees_) == -1)
+        return -1;
+    y0_ = flat_trees_.y0();
+    set_engine(engine);
+    return 0;
 }
 
-int GBDTPredictor::load_json(FILE * fp)
+int GBDTPredictor::save_binary(FILE * fp) const
 {
-    return ::load_json(fp, &y0_, &trees_);
+    return ::save_binary(fp, flat_trees_);
 }
 
 void GBDTTrainer::save_json(FILE * fp) const
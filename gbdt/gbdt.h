@@ -1,24 +1,49 @@
 #ifndef GBDT_GBDT_H
 #define GBDT_GBDT_H
 
+#include "binary.h"
+#include "flat-trees.h"
 #include "param.h"
+#include "quick-scorer.h"
 #include "sample.h"
 #include <stdio.h>
 #include <vector>
 
 class TreeNodeBase;
+class ThreadPool;
 
 class GBDTPredictor
 {
+public:
+    // prediction engines, both give the same results
+    enum kEngine
+    {
+        kEngine_FlatTrees = 0,
+        kEngine_QuickScorer = 1,
+    };
+
 protected:
     double y0_;
     std::vector<TreeNodeBase *> trees_;
+    // packed 'trees_' used by predict
+    FlatTrees flat_trees_;
+    // built from 'flat_trees_' for kEngine_QuickScorer, used by predict if not empty
+    QuickScorer quick_scorer_;
+    // mapped arrays of 'flat_trees_' loaded by load_binary
+    BinaryModel binary_model_;
+    void set_engine(kEngine engine);
 public:
     GBDTPredictor() {}
     virtual ~GBDTPredictor() {clear();}
     double predict(const CompoundValueVector& X) const;
     double predict_logistic(const CompoundValueVector& X) const;
-    int load_json(FILE * fp);
+    // see FlatTrees::predict_batch
+    void predict_batch(const double * rows, size_t n, size_t stride, double * out) const;
+    // kEngine_QuickScorer falls back to kEngine_FlatTrees for unsupported models
+    int load_json(FILE * fp, kEngine engine = kEngine_FlatTrees);
+    // map a model written by save_binary, the file must not change while loaded
+    int load_binary(const char * filename, kEngine engine = kEngine_FlatTrees);
+    int save_binary(FILE * fp) const;
     void clear();
 };
 
@@ -27,14 +52,22 @@ class GBDTTrainer : public GBDTPredictor
 private:
     const XYSet& full_set_;
     const TreeParam& param_;
+    // fx of the samples trained, the first 'train_size_' of 'full_set_'
     std::vector<double> full_fx_;
+    // 0: all samples of 'full_set_' when train is called
+    size_t train_size_;
     const TreeNodeBase * holder_;
+    ThreadPool * pool_;
     double total_loss() const;
     void dump_feature_importance() const;
 public:
-    GBDTTrainer(const XYSet& set, const TreeParam& param);
+    // train on the first 'train_size' samples of 'set', all of them if 0;
+    // 'set' is only read, so trainers may share it across threads
+    GBDTTrainer(const XYSet& set, const TreeParam& param, size_t train_size = 0);
     virtual ~GBDTTrainer();
-    void train();
+    // -1 if histogram training is asked for and the set was not limited
+    // to gbdt_histogram_bins x values by 'limit_x_values'
+    int train();
     void save_json(FILE * fp) const;
 };
 
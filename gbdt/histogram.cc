@@ -0,0 +1,78 @@
+#include "histogram.h"
+#include "thread-pool.h"
+#include <assert.h>
+
+void Histogram::build(const XYSetRef& set, const std::vector<double>& response, ThreadPool * pool)
+{
+    assert(set.size() == response.size());
+    size_t x_size = set.get_x_type_size();
+    offsets_.resize(x_size + 1);
+    offsets_[0] = 0;
+    for (size_t i=0; i<x_size; i++)
+        offsets_[i+1] = offsets_[i] + set.get_x_values(i).size() + 1;
+    bins_.assign(offsets_[x_size], HistogramBin());
+
+    response_ = 0.0;
+    response2_ = 0.0;
+    weight_ = 0.0;
+    for (size_t i=0, s=set.size(); i<s; i++)
+    {
+        double weight = set.weight(i);
+        double r = response[i];
+        response_ += r * weight;
+        response2_ += r * r * weight;
+        weight_ += weight;
+    }
+
+    const XYSet& full_set = *set.full_set();
+    const std::vector<uint32_t>& rows = set.rows();
+    std::function<void(size_t)> build_one = [&](size_t x_index)
+    {
+        const XBinVector& x_bins = set.get_x_bins(x_index);
+        HistogramBin * bins = &bins_[offsets_[x_index]];
+        for (size_t i=0, s=set.size(); i<s; i++)
+        {
+            uint32_t row = rows[i];
+            HistogramBin& bin = bins[x_bins[row]];
+            double weight = full_set.weight(row);
+            bin.response += response[i] * weight;
+            bin.weight += weight;
+        }
+    };
+
+    if (pool)
+    {
+        pool->parallel_for(x_size, build_one);
+    }
+    else
+    {
+        for (size_t x_index=0; x_index<x_size; x_index++)
+            build_one(x_index);
+    }
+}
+
+void Histogram::subtract(const Histogram& parent, const Histogram& sibling)
+{
+    assert(parent.offsets_ == sibling.offsets_);
+    offsets_ = parent.offsets_;
+    bins_.resize(parent.bins_.size());
+    for (size_t i=0, s=bins_.size(); i<s; i++)
+    {
+        bins_[i].response = parent.bins_[i].response - sibling.bins_[i].response;
+        bins_[i].weight = parent.bins_[i].weight - sibling.bins_[i].weight;
+    }
+
+    response_ = parent.response_ - sibling.response_;
+    response2_ = parent.response2_ - sibling.response2_;
+    weight_ = parent.weight_ - sibling.weight_;
+}
+
+void Histogram::clear()
+{
+    // release memory, a node's histogram is not used after it is split
+    std::vector<size_t>().swap(offsets_);
+    std::vector<HistogramBin>().swap(bins_);
+    response_ = 0.0;
+    response2_ = 0.0;
+    weight_ = 0.0;
+}
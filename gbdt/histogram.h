@@ -0,0 +1,51 @@
+#ifndef GBDT_HISTOGRAM_H
+#define GBDT_HISTOGRAM_H
+
+#include "sample.h"
+#include <stddef.h>
+#include <vector>
+
+class ThreadPool;
+
+// sums of the samples falling into one bin
+struct HistogramBin
+{
+    // sum of weight * response
+    double response;
+    // sum of weight
+    double weight;
+
+    HistogramBin() : response(0.0), weight(0.0) {}
+};
+
+// per-feature histograms of the samples in a tree node
+class Histogram
+{
+private:
+    // bins of the ith feature are bins_[offsets_[i]] ... bins_[offsets_[i+1]-1]
+    std::vector<size_t> offsets_;
+    std::vector<HistogramBin> bins_;
+    // sums of all samples
+    double response_;
+    double response2_;// sum of weight * response * response
+    double weight_;
+
+public:
+    Histogram() : response_(0.0), response2_(0.0), weight_(0.0) {}
+
+    bool empty() const {return bins_.empty();}
+    size_t get_bin_size(size_t x_index) const {return offsets_[x_index+1] - offsets_[x_index];}
+    const HistogramBin * get_bins(size_t x_index) const {return &bins_[offsets_[x_index]];}
+    double response() const {return response_;}
+    double response2() const {return response2_;}
+    double weight() const {return weight_;}
+
+    // accumulate 'response' of all samples in 'set' into bins,
+    // features are spread over 'pool' if it is not null
+    void build(const XYSetRef& set, const std::vector<double>& response, ThreadPool * pool);
+    // get histogram of a node from its parent's and its sibling's
+    void subtract(const Histogram& parent, const Histogram& sibling);
+    void clear();
+};
+
+#endif// GBDT_HISTOGRAM_H
@@ -5,6 +5,7 @@
 #include "node.h"
 #include <assert.h>
 #include <math.h>
+#include <functional>
 
 class LambdaMARTNode : public TreeNodeBase
 {
@@ -21,10 +22,7 @@ private:
     {
         double total_y  = 0.0;
         for (size_t i=0, s=full_set.size(); i<s; i++)
-        {
-            const XY& xy = full_set.get(i);
-            total_y += (double)xy.label();
-        }
+            total_y += (double)full_set.label(i);
         return total_y / full_set.size();
     }
 
@@ -48,18 +46,20 @@ public:
         return node;
     }
 
-    virtual void initial_fx(const XYSet& full_set,
+    virtual void initial_fx(const XYSet& full_set, size_t size,
         std::vector<double> * full_fx, double * y0) const
     {
+        // queries are not split
+        assert(size == full_set.size());
         *y0 = mean_y(full_set);
-        full_fx->assign(full_set.size(), *y0);
+        full_fx->assign(size, *y0);
     }
 
 protected:
-    virtual void add_data(const XY& xy, const TreeNodeBase * parent, size_t _index)
+    virtual void add_data(const TreeNodeBase * parent, size_t _index)
     {
         assert(!is_root());
-        set().add(xy);
+        set().add(parent->set().row(_index));
         LambdaMARTNode * lm_parent = (LambdaMARTNode *)parent;
         response_.push_back(lm_parent->response_[_index]);
         weights_.push_back(lm_parent->weights_[_index]);
@@ -88,18 +88,20 @@ protected:
         size_t begin = 0;
         for (size_t i=0, s=n_samples_per_query_->size(); i<s; i++)
         {
-            // for each query-result list
-            const XY * const * results = &xy_set.sample()[begin];
+            // for each query-result list, labels of the results
             size_t result_size = (*n_samples_per_query_)[i];
+            std::vector<size_t> results; results.reserve(result_size);
+            for (size_t j=0; j<result_size; j++)
+                results.push_back(xy_set.label(begin + j));
 
             // sort 'results'
             std::vector<size_t> indices;
-            sort_indices(results, result_size, &indices, XYLabelGreater());
+            sort_indices(&results[0], result_size, &indices, std::greater<size_t>());
 
             SymmetricMatrixD delta;
             std::vector<size_t> labels; labels.reserve(result_size);
             for (size_t j=0; j<result_size; j++)
-                labels.push_back(results[indices[j]]->label());
+                labels.push_back(results[indices[j]]);
             scorer_->get_delta(labels, &delta);
 
             // 'j', 'k' are indices in 'indices' and 'results[indices[j]]'.
@@ -108,15 +110,15 @@ protected:
             {
                 // for each result in the sorted query-result list 'results[indices[j]]'
                 size_t jj = indices[j] + begin;
-                const XY * xy_j = results[indices[j]];
+                size_t label_j = results[indices[j]];
                 for (size_t k=0; k<result_size; k++)
                 {
                     if (j > cutoff && k > cutoff)
                         break;
 
                     size_t kk = indices[k] + begin;
-                    const XY * xy_k = results[indices[k]];
-                    if (xy_j->label() > xy_k->label())
+                    size_t label_k = results[indices[k]];
+                    if (label_j > label_k)
                     {
                         double delta_jk = delta.at(j, k);
                         if (delta_jk > 0.0)
@@ -203,7 +205,7 @@ void LambdaMARTTrainer::train()
 {
     assert(trees_.empty());
 
-    holder_->initial_fx(full_set_, &full_fx_, &y0_);
+    holder_->initial_fx(full_set_, full_set_.size(), &full_fx_, &y0_);
 
     for (size_t i=0; i<param_.tree_number; i++)
     {
@@ -1,6 +1,8 @@
 #include "node.h"
+#include "thread-pool.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <limits>
 #include <list>
 
@@ -55,9 +57,10 @@ public:
     (_split_x_type)?((x.d()) <= (_split_x_value.d())):((x.i()) == (_split_x_value.i()))
 
 TreeNodeBase::TreeNodeBase(const TreeParam& param, size_t level)
-    : param_(param), level_(level),
+    : param_(param), level_(level), pool_(0),
     left_(0), right_(0),
-    total_loss_(0.0), loss_(0.0) {}
+    total_loss_(0.0), loss_(0.0),
+    leaf_(false), y_(0.0) {}
 
 TreeNodeBase::~TreeNodeBase()
 {
@@ -73,6 +76,7 @@ TreeNodeBase * TreeNodeBase::train(
     std::vector<double> * full_fx) const
 {
     TreeNodeBase * root = clone(param, 0);
+    root->pool() = pool();
     root->do_train(full_set, param, full_fx);
     return root;
 }
@@ -87,7 +91,7 @@ void TreeNodeBase::do_train(
     const TreeParam& param,
     std::vector<double> * full_fx)
 {
-    assert(full_set.size() == full_fx->size());
+    assert(full_set.size() >= full_fx->size());
     leaf() = false;
     sample_and_update_response(full_set, param, *full_fx);
     build_tree();
@@ -104,21 +108,20 @@ void TreeNodeBase::sample_and_update_response(
     XYSetRef& xy_set = set();
     if (param.gbdt_sample_rate >= 1.0)
     {
-        xy_set.load(full_set);
+        xy_set.load(full_set, full_fx.size());
         update_response(full_fx);
     }
     else
     {
         std::vector<double> sampled_fx;
         // sample 'full_set' and 'full_fx' together
-        xy_set.spec() = &full_set.spec();
-        xy_set.x_values() = &full_set.x_values();
+        xy_set.full_set() = &full_set;
         Rand01 r(param.gbdt_sample_rate);
-        for (size_t i=0, s=full_set.size(); i<s; i++)
+        for (size_t i=0, s=full_fx.size(); i<s; i++)
         {
             if (r.is_one())
             {
-                xy_set.add(full_set.get(i));
+                xy_set.add((uint32_t)i);
                 sampled_fx.push_back(full_fx[i]);
             }
         }
@@ -142,10 +145,7 @@ void TreeNodeBase::build_tree()
         TreeNodeBase * node = stack.back();
         stack.pop_back();
 
-        size_t level = node->level();
-        if (level >= _param.max_level
-            || leaf_size >= _param.max_leaf_number
-            || node->set().size() <= _param.min_values_in_leaf)
+        if (leaf_size >= _param.max_leaf_number || !node->can_split())
         {
             node->leaf() = true;
             node->update_predicted_y();
@@ -160,10 +160,20 @@ void TreeNodeBase::build_tree()
     }
 }
 
+bool TreeNodeBase::can_split() const
+{
+    const TreeParam& _param = param();
+    return level() < _param.max_level && set().size() > _param.min_values_in_leaf;
+}
+
 void TreeNodeBase::split()
 {
     const XYSetRef& xy_set = set();
     assert(xy_set.size() != 0);
+    // non-root nodes got their histograms when their parents were split
+    if (param().gbdt_histogram_bins && histogram_.empty())
+        histogram_.build(xy_set, response_, pool());
+
     double y_left = 0.0;
     double y_right = 0.0;
     min_loss_on_all_features(&split_x_index(),
@@ -180,14 +190,17 @@ void TreeNodeBase::split()
     _left->y() = y_left;
     _right->y() = y_right;
     split_data(_left, _right);
+    if (param().gbdt_histogram_bins)
+        split_histogram(_left, _right);
+    histogram_.clear();
 }
 
 TreeNodeBase * TreeNodeBase::fork() const
 {
     const XYSetRef& xy_set = set();
     TreeNodeBase * child = clone(param(), level() + 1);
-    child->set().spec() = xy_set.spec();
-    child->set().x_values() = xy_set.x_values();
+    child->pool() = pool();
+    child->set().full_set() = xy_set.full_set();
     child->leaf() = false;
     return child;
 }
@@ -197,19 +210,50 @@ void TreeNodeBase::split_data(TreeNodeBase * _left, TreeNodeBase * _right) const
     const XYSetRef& xy_set = set();
     size_t _split_x_index = split_x_index();
     const CompoundValue& _split_x_value = split_x_value();
+    const CompoundValueVector& column = xy_set.full_set()->get_x_column(_split_x_index);
+    const std::vector<uint32_t>& rows = xy_set.rows();
     for (size_t i=0, s=xy_set.size(); i<s; i++)
     {
-        const XY& xy = xy_set.get(i);
-        const CompoundValue& x = xy.x(_split_x_index);
+        const CompoundValue& x = column[rows[i]];
         if (X_LIES_LEFT(x, _split_x_value, split_x_type()))
-            _left->add_data(xy, this, i);
+            _left->add_data(this, i);
         else
-            _right->add_data(xy, this, i);
+            _right->add_data(this, i);
     }
 
     assert(xy_set.size() == _left->set().size() + _right->set().size());
 }
 
+void TreeNodeBase::split_histogram(TreeNodeBase * _left, TreeNodeBase * _right) const
+{
+    TreeNodeBase * smaller = _left;
+    TreeNodeBase * larger = _right;
+    if (smaller->set().size() > larger->set().size())
+        std::swap(smaller, larger);
+
+    // children that will be leaves need no histograms
+    bool smaller_split = smaller->can_split();
+    bool larger_split = larger->can_split();
+
+    if (!param().gbdt_histogram_subtraction)
+    {
+        if (smaller_split)
+            smaller->histogram_.build(smaller->set(), smaller->response_, pool());
+        if (larger_split)
+            larger->histogram_.build(larger->set(), larger->response_, pool());
+        return;
+    }
+
+    if (!smaller_split && !larger_split)
+        return;
+
+    smaller->histogram_.build(smaller->set(), smaller->response_, pool());
+    if (larger_split)
+        larger->histogram_.subtract(histogram_, smaller->histogram_);
+    if (!smaller_split)
+        smaller->histogram_.clear();
+}
+
 void TreeNodeBase::shrink()
 {
     if (param().learning_rate >= 1.0)
@@ -220,11 +264,52 @@ void TreeNodeBase::shrink()
 void TreeNodeBase::update_fx(const XYSet& full_set, std::vector<double> * full_fx) const
 {
     assert(is_root());
-    for (size_t i=0, s=full_set.size(); i<s; i++)
+    // Samples of the tree already know their leaves,
+    // only those left out by sampling walk down the tree.
+    std::vector<const TreeNodeBase *> leaves;
+    get_leaves(&leaves);
+
+    std::vector<const TreeNodeBase *> sample_leaves(full_fx->size(), 0);
+    std::function<void(size_t)> assign_one = [&](size_t i)
     {
-        const XY& xy = full_set.get(i);
-        (*full_fx)[i] += predict(xy.X());
+        const TreeNodeBase * leaf = leaves[i];
+        const std::vector<uint32_t>& rows = leaf->set().rows();
+        for (size_t j=0, s=rows.size(); j<s; j++)
+            sample_leaves[rows[j]] = leaf;
+    };
+
+    if (pool())
+    {
+        pool()->parallel_for(leaves.size(), assign_one);
     }
+    else
+    {
+        for (size_t i=0, s=leaves.size(); i<s; i++)
+            assign_one(i);
+    }
+
+    parallel_for_range(full_fx->size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i=begin; i<end; i++)
+        {
+            const TreeNodeBase * leaf = sample_leaves[i];
+            if (leaf)
+                (*full_fx)[i] += leaf->y();
+            else
+                (*full_fx)[i] += __predict(this, full_set, i);
+        }
+    });
+}
+
+void TreeNodeBase::get_leaves(std::vector<const TreeNodeBase *> * leaves) const
+{
+    if (is_leaf())
+    {
+        leaves->push_back(this);
+        return;
+    }
+    left()->get_leaves(leaves);
+    right()->get_leaves(leaves);
 }
 
 void TreeNodeBase::clear_tree()
@@ -245,23 +330,55 @@ void TreeNodeBase::min_loss_on_all_features(
     double * min_loss) const
 {
     const XYSetRef& xy_set = set();
-    *min_loss = std::numeric_limits<double>::max();
-    for (size_t x_index=0, s=xy_set.get_x_type_size(); x_index<s; x_index++)
+    size_t x_size = xy_set.get_x_type_size();
+
+    // the best split of every feature
+    struct Split
     {
-        kXType x_type = xy_set.get_x_type(x_index);
         CompoundValue x_value;
-        double y_left = 0.0;
-        double y_right = 0.0;
+        double y_left;
+        double y_right;
         double loss;
-        min_loss_on_one_feature(x_index, x_type, &x_value, &y_left, &y_right, &loss);
-        if (loss < *min_loss)
+    };
+    std::vector<Split> splits(x_size);
+
+    std::function<void(size_t)> split_one = [&](size_t x_index)
+    {
+        kXType x_type = xy_set.get_x_type(x_index);
+        Split& split = splits[x_index];
+        split.y_left = 0.0;
+        split.y_right = 0.0;
+        if (param().gbdt_histogram_bins)
+            min_loss_on_one_feature_histogram(x_index, x_type,
+                &split.x_value, &split.y_left, &split.y_right, &split.loss);
+        else
+            min_loss_on_one_feature(x_index, x_type,
+                &split.x_value, &split.y_left, &split.y_right, &split.loss);
+    };
+
+    if (pool())
+    {
+        pool()->parallel_for(x_size, split_one);
+    }
+    else
+    {
+        for (size_t x_index=0; x_index<x_size; x_index++)
+            split_one(x_index);
+    }
+
+    // reduce in feature order, so the result does not depend on thread number
+    *min_loss = std::numeric_limits<double>::max();
+    for (size_t x_index=0; x_index<x_size; x_index++)
+    {
+        const Split& split = splits[x_index];
+        if (split.loss < *min_loss)
         {
             *_split_x_index = x_index;
-            *_split_x_type = x_type;
-            *_split_x_value = x_value;
-            *_y_left = y_left;
-            *_y_right = y_right;
-            *min_loss = loss;
+            *_split_x_type = xy_set.get_x_type(x_index);
+            *_split_x_value = split.x_value;
+            *_y_left = split.y_left;
+            *_y_right = split.y_right;
+            *min_loss = split.loss;
         }
     }
 }
@@ -293,6 +410,66 @@ void TreeNodeBase::min_loss_on_one_feature(
     }
 }
 
+void TreeNodeBase::min_loss_on_one_feature_histogram(
+    size_t _split_x_index,
+    kXType _split_x_type,
+    CompoundValue * _split_x_value,
+    double * _y_left,
+    double * _y_right,
+    double * min_loss) const
+{
+    const CompoundValueVector& unique_x_values = set().get_x_values(_split_x_index);
+    const HistogramBin * bins = histogram_.get_bins(_split_x_index);
+    assert(histogram_.get_bin_size(_split_x_index) == unique_x_values.size() + 1);
+    bool numerical = (_split_x_type == kXType_Numerical);
+    double y_left_total = 0.0;
+    double n_left_total = 0.0;
+    *min_loss = std::numeric_limits<double>::max();
+    for (size_t i=0, s=unique_x_values.size(); i<s; i++)
+    {
+        // x lies left if its bin <= i for numerical features,
+        // or its bin == i for category features.
+        if (numerical)
+        {
+            y_left_total += bins[i].response;
+            n_left_total += bins[i].weight;
+        }
+        else
+        {
+            y_left_total = bins[i].response;
+            n_left_total = bins[i].weight;
+        }
+
+        double y_left = y_left_total;
+        double n_left = n_left_total;
+        double y_right = histogram_.response() - y_left_total;
+        double n_right = histogram_.weight() - n_left_total;
+
+        if (y_left < EPS && n_left < EPS)
+            y_left = 0.0;
+        else
+            y_left /= n_left;
+
+        if (y_right < EPS && n_right < EPS)
+            y_right = 0.0;
+        else
+            y_right /= n_right;
+
+        // sum(w * (r - y)^2) = sum(w * r^2) - 2 * y * sum(w * r) + y^2 * sum(w)
+        double loss = histogram_.response2()
+            - 2.0 * y_left * y_left_total + y_left * y_left * n_left_total
+            - 2.0 * y_right * (histogram_.response() - y_left_total)
+            + y_right * y_right * (histogram_.weight() - n_left_total);
+        if (loss < *min_loss)
+        {
+            *_split_x_value = unique_x_values[i];
+            *_y_left = y_left;
+            *_y_right = y_right;
+            *min_loss = loss;
+        }
+    }
+}
+
 void TreeNodeBase::loss_x(
     size_t _split_x_index,
     kXType _split_x_type,
@@ -302,6 +479,9 @@ void TreeNodeBase::loss_x(
     double * _loss) const
 {
     const XYSetRef& xy_set = set();
+    const XYSet& full_set = *xy_set.full_set();
+    const CompoundValueVector& column = full_set.get_x_column(_split_x_index);
+    const std::vector<uint32_t>& rows = xy_set.rows();
     double n_left = 0.0;
     double n_right = 0.0;
     double y_left = 0.0;
@@ -309,9 +489,9 @@ void TreeNodeBase::loss_x(
 
     for (size_t i=0, s=xy_set.size(); i<s; i++)
     {
-        const XY& xy = xy_set.get(i);
-        const CompoundValue& x = xy.x(_split_x_index);
-        double weight = xy.weight();
+        uint32_t row = rows[i];
+        const CompoundValue& x = column[row];
+        double weight = full_set.weight(row);
         double response = response_[i];
         if (X_LIES_LEFT(x, _split_x_value, _split_x_type))
         {
@@ -349,12 +529,15 @@ void TreeNodeBase::__loss_x(
     double * _loss) const
 {
     const XYSetRef& xy_set = set();
+    const XYSet& full_set = *xy_set.full_set();
+    const CompoundValueVector& column = full_set.get_x_column(_split_x_index);
+    const std::vector<uint32_t>& rows = xy_set.rows();
     double ls_loss = 0.0;
     for (size_t i=0, s=xy_set.size(); i<s; i++)
     {
-        const XY& xy = xy_set.get(i);
-        const CompoundValue& x = xy.x(_split_x_index);
-        double weight = xy.weight();
+        uint32_t row = rows[i];
+        const CompoundValue& x = column[row];
+        double weight = full_set.weight(row);
         double diff;
         if (X_LIES_LEFT(x, _split_x_value, _split_x_type))
             diff = response_[i] - _y_left;
@@ -383,6 +566,23 @@ double TreeNodeBase::__predict(const TreeNodeBase * node, const CompoundValueVec
     }
 }
 
+double TreeNodeBase::__predict(const TreeNodeBase * node, const XYSet& set, size_t i)
+{
+    for (;;)
+    {
+        if (node->is_leaf())
+            return node->y();
+
+        const CompoundValue& x = set.x(i, node->split_x_index());
+        const CompoundValue& _split_x_value = node->split_x_value();
+        if (X_LIES_LEFT(x, _split_x_value, node->split_x_type()))
+            node = node->left();
+        else
+            node = node->right();
+        assert(node);
+    }
+}
+
 double TreeNodeBase::total_loss(
     const XYSet& full_set,
     const std::vector<double>& full_fx) const
@@ -390,10 +590,18 @@ double TreeNodeBase::total_loss(
     return 0.0;
 }
 
-void TreeNodeBase::add_data(const XY& xy, const TreeNodeBase * parent, size_t _index)
+void TreeNodeBase::parallel_for_range(size_t n, const std::function<void(size_t, size_t)>& task) const
+{
+    if (pool())
+        pool()->parallel_for_range(n, task);
+    else
+        task(0, n);
+}
+
+void TreeNodeBase::add_data(const TreeNodeBase * parent, size_t _index)
 {
     assert(!is_root());
-    set().add(xy);
+    set().add(parent->set().row(_index));
     response_.push_back(parent->response_[_index]);
 }
 
@@ -401,6 +609,7 @@ void TreeNodeBase::clear()
 {
     set().clear();
     response_.clear();
+    histogram_.clear();
 }
 
 /************************************************************************/
@@ -426,6 +635,7 @@ TreeNodeBase * TreeNodePredictor::clone(
 
 void TreeNodePredictor::initial_fx(
     const XYSet& full_set,
+    size_t size,
     std::vector<double> * full_fx,
     double * y0) const
 {
@@ -1,14 +1,20 @@
 #ifndef GBDT_NODE_H
 #define GBDT_NODE_H
 
+#include "histogram.h"
 #include "param.h"
 #include "sample.h"
+#include <functional>
+
+class ThreadPool;
 
 class TreeNodeBase
 {
 private:
     const TreeParam& param_;
     const size_t level_;
+    // shared by all nodes of a tree, may be null
+    ThreadPool * pool_;
 
     TreeNodeBase * left_;
     TreeNodeBase * right_;
@@ -29,6 +35,9 @@ private:
     // predicted y in this leaf node
     double y_;
 
+    // histogram training only
+    Histogram histogram_;
+
 protected:
     // pseudo response
     std::vector<double> response_;
@@ -36,6 +45,8 @@ protected:
 public:
     const TreeParam& param() const {return param_;}
     size_t level() const {return level_;}
+    ThreadPool *& pool() {return pool_;}
+    ThreadPool * pool() const {return pool_;}
     bool is_root() const {return level_ == 0;}
     TreeNodeBase *& left() {return left_;}
     const TreeNodeBase * left() const {return left_;}
@@ -66,6 +77,7 @@ protected:
 
 public:
     virtual ~TreeNodeBase();
+    // train on the first full_fx->size() samples of 'full_set'
     TreeNodeBase * train(
         const XYSet& full_set,
         const TreeParam& param,
@@ -84,11 +96,14 @@ private:
         const TreeParam& param,
         const std::vector<double>& full_fx);
     void build_tree();
+    bool can_split() const;
     void split();
     TreeNodeBase * fork() const;
     void split_data(TreeNodeBase * _left, TreeNodeBase * _right) const;
+    void split_histogram(TreeNodeBase * _left, TreeNodeBase * _right) const;
     void shrink();
     void update_fx(const XYSet& full_set, std::vector<double> * full_fx) const;
+    void get_leaves(std::vector<const TreeNodeBase *> * leaves) const;
     void clear_tree();
     void min_loss_on_all_features(
         size_t * _split_x_index,
@@ -104,6 +119,13 @@ private:
         double * _y_left,
         double * _y_right,
         double * min_loss) const;
+    void min_loss_on_one_feature_histogram(
+        size_t _split_x_index,
+        kXType _split_x_type,
+        CompoundValue * _split_x_value,
+        double * _y_left,
+        double * _y_right,
+        double * min_loss) const;
     void loss_x(
         size_t _split_x_index,
         kXType _split_x_type,
@@ -119,6 +141,7 @@ private:
         double _y_right,
         double * _loss) const;
     static double __predict(const TreeNodeBase * node, const CompoundValueVector& X);
+    static double __predict(const TreeNodeBase * node, const XYSet& set, size_t i);
 
 public:
     virtual double total_loss(
@@ -127,14 +150,17 @@ public:
     virtual TreeNodeBase * clone(
         const TreeParam& param,
         size_t level) const = 0;
-    // for the first tree
+    // for the first tree, of the first 'size' samples of 'full_set'
     virtual void initial_fx(
         const XYSet& full_set,
+        size_t size,
         std::vector<double> * full_fx,
         double * y0) const = 0;
 
 protected:
-    virtual void add_data(const XY& xy, const TreeNodeBase * parent, size_t _index);
+    // call 'task(begin, end)' on ranges covering [0, n), on the pool if there is one
+    void parallel_for_range(size_t n, const std::function<void(size_t, size_t)>& task) const;
+    virtual void add_data(const TreeNodeBase * parent, size_t _index);
     virtual void clear();
     virtual void update_response(const std::vector<double>& fx) = 0;
     virtual void update_predicted_y() = 0;
@@ -152,6 +178,7 @@ public:
         size_t level) const;
     virtual void initial_fx(
         const XYSet& full_set,
+        size_t size,
         std::vector<double> * full_fx,
         double * y0) const;
 protected:
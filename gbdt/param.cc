@@ -185,6 +185,9 @@ public:
             DECLARE_PARAM(param, std_string, model),
             DECLARE_PARAM(param, double, gbdt_sample_rate),
             DECLARE_PARAM2(param, std_string, gbdt_loss),
+            DECLARE_PARAM(param, size_t, gbdt_histogram_bins),
+            DECLARE_PARAM(param, int, gbdt_histogram_subtraction),
+            DECLARE_PARAM(param, size_t, num_threads),
         };
         TreeParamSpec lm_specs[] =
         {
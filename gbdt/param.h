@@ -22,11 +22,22 @@ struct TreeParam
 
     double gbdt_sample_rate;
     std::string gbdt_loss;
+    // 0: find splits by scanning samples for every x value
+    // others: find splits from per-node histograms,
+    // x values must have been limited to as many by 'limit_x_values'
+    size_t gbdt_histogram_bins;
+    // histogram training only
+    // 1: build histogram of the smaller child, and get the larger one's by subtraction
+    // 0: build histograms of both children
+    int gbdt_histogram_subtraction;
+
+    // number of threads searching splits, 1 is single threaded
+    size_t num_threads;
 
     std::string lm_metric;
     size_t lm_ndcg_k;
 
-    TreeParam() {}
+    TreeParam() : gbdt_histogram_bins(0), gbdt_histogram_subtraction(1), num_threads(1) {}
 };
 
 int gbdt_parse_tree_param(int argc, char ** argv, TreeParam * param);
@@ -0,0 +1,165 @@
+#include "quick-scorer.h"
+#include "flat-trees.h"
+#include <assert.h>
+#include <algorithm>
+
+struct QuickScorerNode
+{
+    uint32_t x_index;
+    double split_value;
+    uint32_t tree;
+    uint64_t mask;
+};
+
+struct QuickScorerNodeLess
+{
+    bool operator()(const QuickScorerNode& a, const QuickScorerNode& b) const
+    {
+        if (a.x_index != b.x_index)
+            return a.x_index < b.x_index;
+        return a.split_value < b.split_value;
+    }
+};
+
+class QuickScorerBuilder
+{
+private:
+    const FlatTrees& flat_trees_;
+    uint32_t tree_;
+
+public:
+    std::vector<QuickScorerNode> nodes;
+    std::vector<double> leaf_values;
+
+    explicit QuickScorerBuilder(const FlatTrees& flat_trees)
+        : flat_trees_(flat_trees), tree_(0) {}
+
+    void set_tree(uint32_t tree) {tree_ = tree;}
+
+    // add the subtree of 'node' whose first leaf is 'first_leaf',
+    // return the number of leaves in it or -1 if it is not supported
+    int add(uint32_t node, size_t first_leaf)
+    {
+        uint8_t type = flat_trees_.type()[node];
+        if (type == FlatTrees::kLeaf)
+        {
+            if (first_leaf >= QuickScorer::MAX_LEAF_NUMBER)
+                return -1;
+            leaf_values.push_back(flat_trees_.value()[node].d());
+            return 1;
+        }
+
+        if (type != kXType_Numerical)
+            return -1;
+
+        int left = add(node + 1, first_leaf);
+        if (left == -1)
+            return -1;
+        int right = add(flat_trees_.right()[node], first_leaf + left);
+        if (right == -1)
+            return -1;
+
+        QuickScorerNode qs_node;
+        qs_node.x_index = flat_trees_.x_index()[node];
+        qs_node.split_value = flat_trees_.value()[node].d();
+        qs_node.tree = tree_;
+        // 'left' < 64 here, as the right subtree has leaves too
+        qs_node.mask = ~((((uint64_t)1 << left) - 1) << first_leaf);
+        nodes.push_back(qs_node);
+        return left + right;
+    }
+};
+
+int QuickScorer::build(const FlatTrees& flat_trees)
+{
+    clear();
+    if (flat_trees.empty())
+        return -1;
+
+    QuickScorerBuilder builder(flat_trees);
+    std::vector<uint32_t> leaf_offsets;
+    for (size_t i=0, s=flat_trees.tree_size(); i<s; i++)
+    {
+        leaf_offsets.push_back((uint32_t)builder.leaf_values.size());
+        builder.set_tree((uint32_t)i);
+        if (builder.add(flat_trees.roots()[i], 0) == -1)
+            return -1;
+    }
+
+    std::vector<QuickScorerNode>& nodes = builder.nodes;
+    std::stable_sort(nodes.begin(), nodes.end(), QuickScorerNodeLess());
+
+    size_t x_size = nodes.empty() ? 0 : nodes.back().x_index + 1;
+    feature_offsets_.assign(x_size + 1, 0);
+    for (size_t i=0, s=nodes.size(); i<s; i++)
+    {
+        const QuickScorerNode& node = nodes[i];
+        feature_offsets_[node.x_index + 1]++;
+        split_values_.push_back(node.split_value);
+        trees_.push_back(node.tree);
+        masks_.push_back(node.mask);
+    }
+    for (size_t i=0; i<x_size; i++)
+        feature_offsets_[i+1] += feature_offsets_[i];
+
+    y0_ = flat_trees.y0();
+    tree_size_ = flat_trees.tree_size();
+    leaf_offsets_.swap(leaf_offsets);
+    leaf_values_.swap(builder.leaf_values);
+    return 0;
+}
+
+void QuickScorer::clear()
+{
+    y0_ = 0.0;
+    tree_size_ = 0;
+    feature_offsets_.clear();
+    split_values_.clear();
+    trees_.clear();
+    masks_.clear();
+    leaf_offsets_.clear();
+    leaf_values_.clear();
+}
+
+double QuickScorer::predict(const double * X, uint64_t * leaves) const
+{
+    for (size_t i=0; i<tree_size_; i++)
+        leaves[i] = ~(uint64_t)0;
+
+    for (size_t x_index=0, s=feature_offsets_.size()-1; x_index<s; x_index++)
+    {
+        double x = X[x_index];
+        for (uint32_t i=feature_offsets_[x_index], end=feature_offsets_[x_index+1]; i<end; i++)
+        {
+            // NaN never breaks, so it goes right as in FlatTrees
+            if (x <= split_values_[i])
+                break;
+            leaves[trees_[i]] &= masks_[i];
+        }
+    }
+
+    // add trees in the same order as FlatTrees
+    double y = y0_;
+    for (size_t i=0; i<tree_size_; i++)
+        y += leaf_values_[leaf_offsets_[i] + __builtin_ctzll(leaves[i])];
+    return y;
+}
+
+double QuickScorer::predict(const CompoundValueVector& X) const
+{
+    assert(!empty());
+    size_t x_size = feature_offsets_.size() - 1;
+    std::vector<double> x(x_size);
+    for (size_t i=0; i<x_size; i++)
+        x[i] = X[i].d();
+    std::vector<uint64_t> leaves(tree_size_);
+    return predict(x.data(), leaves.data());
+}
+
+void QuickScorer::predict_batch(const double * rows, size_t n, size_t stride, double * out) const
+{
+    assert(!empty());
+    std::vector<uint64_t> leaves(tree_size_);
+    for (size_t i=0; i<n; i++)
+        out[i] = predict(rows + i * stride, leaves.data());
+}
@@ -0,0 +1,56 @@
+#ifndef GBDT_QUICK_SCORER_H
+#define GBDT_QUICK_SCORER_H
+
+#include "sample.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class FlatTrees;
+
+// QuickScorer: Lucchese et al., "QuickScorer: a Fast Algorithm to Rank
+// Documents with Additive Ensembles of Regression Trees", SIGIR 2015.
+//
+// Leaves of every tree are numbered from left to right as bits of a
+// bitvector. Every inner node keeps a mask clearing the leaves of its left
+// subtree. For each feature, inner nodes of all trees are sorted by split
+// value, so all false conditions 'x <= split value' of a row are found by a
+// linear scan, and their masks are applied. The exit leaf of a tree is then
+// the lowest bit left.
+//
+// Only numerical splits and trees of at most 64 leaves are supported.
+class QuickScorer
+{
+public:
+    static const size_t MAX_LEAF_NUMBER = 64;
+
+private:
+    double y0_;
+    size_t tree_size_;
+    // nodes of feature i are [feature_offsets_[i], feature_offsets_[i+1])
+    std::vector<uint32_t> feature_offsets_;
+    // inner nodes sorted by feature and split value
+    std::vector<double> split_values_;
+    std::vector<uint32_t> trees_;
+    std::vector<uint64_t> masks_;
+    // leaves of tree i are leaf_values_[leaf_offsets_[i]] ...
+    std::vector<uint32_t> leaf_offsets_;
+    std::vector<double> leaf_values_;
+
+    double predict(const double * X, uint64_t * leaves) const;
+
+public:
+    QuickScorer() {clear();}
+
+    bool empty() const {return tree_size_ == 0;}
+
+    // return -1 if 'flat_trees' is not supported
+    int build(const FlatTrees& flat_trees);
+    void clear();
+
+    // same as FlatTrees::predict and FlatTrees::predict_batch
+    double predict(const CompoundValueVector& X) const;
+    void predict_batch(const double * rows, size_t n, size_t stride, double * out) const;
+};
+
+#endif// GBDT_QUICK_SCORER_H
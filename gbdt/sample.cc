@@ -18,13 +18,14 @@ static void get_unique_x_values(
     kXType x_type)
 {
     x_values->clear();
+    const CompoundValueVector& column = set->get_x_column(x_index);
 
     if (x_type == kXType_Numerical)
     {
         static const size_t MAX_UNIQUE_X_NUMERICAL = 100000;
 
         for (size_t i=0, s=std::min(MAX_UNIQUE_X_NUMERICAL, set->size()); i<s; i++)
-            x_values->push_back(set->get(i).x(x_index));
+            x_values->push_back(column[i]);
 
         std::sort(x_values->begin(), x_values->end(), CompoundValueDoubleLess());
 
@@ -52,7 +53,7 @@ static void get_unique_x_values(
         static const size_t MAX_UNIQUE_X_CATEGORY = 1024;
 
         for (size_t i=0, s=std::min(MAX_UNIQUE_X_CATEGORY, set->size()); i<s; i++)
-            x_values->push_back(set->get(i).x(x_index));
+            x_values->push_back(column[i]);
 
         std::sort(x_values->begin(), x_values->end(), CompoundValueIntLess());
         x_values->erase(std::unique(x_values->begin(), x_values->end(), CompoundValueIntEqual()),
@@ -60,11 +61,101 @@ static void get_unique_x_values(
     }
 }
 
+// get the bin of every sample's x in 'x_values'
+static void get_x_bins(
+    const XYSet& set,
+    const CompoundValueVector& x_values,
+    XBinVector * x_bins,
+    size_t x_index,
+    kXType x_type)
+{
+    x_bins->resize(set.size());
+    const CompoundValueVector& column = set.get_x_column(x_index);
+    CompoundValueVector::const_iterator first = x_values.begin();
+    CompoundValueVector::const_iterator last = x_values.end();
+
+    for (size_t i=0, s=set.size(); i<s; i++)
+    {
+        const CompoundValue& x = column[i];
+        CompoundValueVector::const_iterator it;
+        if (x_type == kXType_Numerical)
+        {
+            // the first x value that is not less than x
+            it = std::lower_bound(first, last, x, CompoundValueDoubleLess());
+        }
+        else
+        {
+            it = std::lower_bound(first, last, x, CompoundValueIntLess());
+            if (it != last && it->i() != x.i())
+                it = last;
+        }
+        (*x_bins)[i] = (uint32_t)(it - first);
+    }
+}
+
+static void get_x_bins(XYSet * set)
+{
+    set->x_bins().resize(set->get_x_type_size());
+    for (size_t i=0, s=set->spec().get_x_type_size(); i<s; i++)
+        get_x_bins(*set, set->get_x_values(i), &set->x_bins()[i], i, set->get_x_type(i));
+}
+
 static void get_unique_x_values(XYSet * set)
 {
     set->x_values().resize(set->get_x_type_size());
     for (size_t i=0, s=set->spec().get_x_type_size(); i<s; i++)
         get_unique_x_values(set, &set->get_x_values(i), i, set->get_x_type(i));
+    // histogram training only, see limit_x_values
+    set->x_bins().clear();
+}
+
+int XYSet::finalize()
+{
+    if (size() == 0)
+        return -1;
+
+    spec_.clear();
+    for (size_t i=0, s=X_.size(); i<s; i++)
+        spec_.add_x_type(kXType_Numerical);
+    get_unique_x_values(this);
+    return 0;
+}
+
+void limit_x_values(XYSet * set, size_t max_x_values)
+{
+    assert(max_x_values != 0);
+    for (size_t i=0, s=set->spec().get_x_type_size(); i<s; i++)
+    {
+        if (set->get_x_type(i) != kXType_Numerical)
+            continue;
+
+        CompoundValueVector& x_values = set->get_x_values(i);
+        size_t size = x_values.size();
+        if (size <= max_x_values)
+            continue;
+
+        // x_values are sorted, so picking evenly spaced ones gives quantiles
+        CompoundValueVector new_x_values;
+        new_x_values.reserve(max_x_values);
+        for (size_t j=1; j<=max_x_values; j++)
+            new_x_values.push_back(x_values[j * size / max_x_values - 1]);
+        x_values.swap(new_x_values);
+    }
+    get_x_bins(set);
+}
+
+bool x_values_limited(const XYSet& set, size_t max_x_values)
+{
+    if (set.x_bins().size() != set.get_x_type_size())
+        return false;
+    for (size_t i=0, s=set.get_x_type_size(); i<s; i++)
+    {
+        if (set.get_x_bins(i).size() != set.size())
+            return false;
+        if (set.get_x_type(i) == kXType_Numerical && set.get_x_values(i).size() > max_x_values)
+            return false;
+    }
+    return true;
 }
 
 class LibLinearLoader
@@ -160,6 +251,7 @@ public:
         ScopedPtrMalloc<char *> line_guard(line);
         char * to_read = line;
         int total_lines = 0, bad_lines = 0;
+        XY xy;
 
         for (;;)
         {
@@ -179,7 +271,7 @@ public:
             {
                 to_read = line;
 
-                XY xy;
+                xy.clear_x();
                 if (load_line(line, &xy) == -1)
                 {
                     fprintf(stderr, "parse line failed:\n\"%s\"\n", line);
@@ -201,8 +293,7 @@ public:
 
         for (size_t i=0; i<x_column_max_; i++)
             set->add_x_type(kXType_Numerical);
-        for (size_t i=0, s=set->size(); i<s; i++)
-            set->get(i).resize_x(x_column_max_);
+        set->resize_x(x_column_max_);
 
         if (set->size() == 0)
             return -1;
@@ -356,6 +447,7 @@ public:
         char * to_read = line;
         int total_lines = 0, bad_lines = 0;
         int loaded_spec = 0;
+        XY xy;
 
         for (;;)
         {
@@ -388,7 +480,7 @@ public:
                 }
                 else
                 {
-                    XY xy;
+                    xy.clear_x();
                     if (load_xy(line, &xy) == -1)
                     {
                         fprintf(stderr, "parse line failed:\n\"%s\"\n", line);
@@ -530,6 +622,7 @@ public:
         char * to_read = line;
         int total_lines = 0, bad_lines = 0;
 
+        XY xy;
         bool first_qid = true;
         long qid = -1;
         size_t qid_count = 0;
@@ -551,7 +644,7 @@ public:
             {
                 to_read = line;
 
-                XY xy;
+                xy.clear_x();
                 long previous_qid = qid;
                 if (load_line(line, &xy, &qid) == -1)
                 {
@@ -596,8 +689,7 @@ public:
 
         for (size_t i=0; i<x_column_max_; i++)
             set->add_x_type(kXType_Numerical);
-        for (size_t i=0, s=set->size(); i<s; i++)
-            set->get(i).resize_x(x_column_max_);
+        set->resize_x(x_column_max_);
 
         if (set->size() == 0)
             return -1;
@@ -2,6 +2,7 @@
 #define GBDT_TRAINING_SAMPLE_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <vector>
 
 #if !defined EPS
@@ -50,6 +51,12 @@ public:
 
 typedef std::vector<CompoundValue> CompoundValueVector;
 
+// bin indices of one feature for all samples
+// For a numerical feature, bin k holds x values in (x_values[k-1], x_values[k]].
+// For a category feature, bin k holds x values equal to x_values[k].
+// The last bin x_values.size() holds the rest.
+typedef std::vector<uint32_t> XBinVector;
+
 struct CompoundValueDoubleLess
 {
     bool operator()(const CompoundValue& a, const CompoundValue& b) const
@@ -74,7 +81,7 @@ struct CompoundValueIntEqual
     }
 };
 
-// a training sample
+// a training sample, used when samples are parsed or predicted
 class XY
 {
 private:
@@ -88,9 +95,14 @@ public:
     size_t get_x_size() const {return X_.size();}
     CompoundValue& x(size_t i) {return X_[i];}
     const CompoundValue& x(size_t i) const {return X_[i];}
+    CompoundValueVector& X() {return X_;}
     const CompoundValueVector& X() const {return X_;}
     void add_x(const CompoundValue& _x) {X_.push_back(_x);}
     void resize_x(size_t s) {X_.resize(s);}
+    // keep the memory for the next sample
+    void clear_x() {X_.clear();}
+
+    const CompoundValue& Y() const {return y_;}
 
     double& y() {return y_.d();}
     double y() const {return y_.d();}
@@ -107,26 +119,21 @@ public:
 #endif
 };
 
-struct XYLabelGreater
-{
-    bool operator()(const XY& a, const XY& b) const
-    {
-        return a.label() > b.label();
-    }
-
-    bool operator()(const XY * a, const XY * b) const
-    {
-        return a->label() > b->label();
-    }
-};
-
-// a set of training samples
+// a set of training samples, stored feature by feature
 class XYSet
 {
 private:
     XYSpec spec_;
     std::vector<CompoundValueVector> x_values_;
-    std::vector<XY> samples_;
+    // x_bins_[i][j] is the bin of the jth sample's ith feature in x_values_[i]
+    std::vector<XBinVector> x_bins_;
+    // X_[i][j] is the jth sample's ith feature
+    std::vector<CompoundValueVector> X_;
+    // y or label
+    CompoundValueVector y_;
+#if !defined DISABLE_WEIGHT
+    std::vector<double> weights_;
+#endif
 
 public:
     XYSpec& spec() {return spec_;}
@@ -135,8 +142,8 @@ public:
     std::vector<CompoundValueVector>& x_values() {return x_values_;}
     const std::vector<CompoundValueVector>& x_values() const {return x_values_;}
 
-    std::vector<XY>& sample() {return samples_;}
-    const std::vector<XY>& sample() const {return samples_;}
+    std::vector<XBinVector>& x_bins() {return x_bins_;}
+    const std::vector<XBinVector>& x_bins() const {return x_bins_;}
 
     size_t get_x_type_size() const {return spec_.get_x_type_size();}
     kXType get_x_type(size_t i) const {return spec_.get_x_type(i);}
@@ -147,70 +154,154 @@ public:
     const CompoundValueVector& get_x_values(size_t i) const {return x_values_[i];}
     void add_x_values(const CompoundValueVector& x_values) {x_values_.push_back(x_values);}
 
-    size_t size() const {return samples_.size();}
-    XY& get(size_t i) {return samples_[i];}
-    const XY& get(size_t i) const {return samples_[i];}
-    void add(const XY& xy) {samples_.push_back(xy);}
+    const XBinVector& get_x_bins(size_t i) const {return x_bins_[i];}
+
+    size_t size() const {return y_.size();}
+    // number of feature columns
+    size_t get_x_size() const {return X_.size();}
+    // all samples' ith feature
+    const CompoundValueVector& get_x_column(size_t i) const {return X_[i];}
+
+    // the ith sample
+    const CompoundValue& x(size_t i, size_t x_index) const {return X_[x_index][i];}
+    double y(size_t i) const {return y_[i].d();}
+    size_t label(size_t i) const {return y_[i].label();}
+#if defined DISABLE_WEIGHT
+    double weight(size_t i) const {return 1.0;}
+#else
+    double weight(size_t i) const {return weights_[i];}
+#endif
+    void get_X(size_t i, CompoundValueVector * X) const
+    {
+        X->resize(X_.size());
+        for (size_t j=0, s=X_.size(); j<s; j++)
+            (*X)[j] = X_[j][i];
+    }
+
+    // set the number of feature columns,
+    // features of added samples are 0 in new columns
+    void resize_x(size_t x_size) {X_.resize(x_size, CompoundValueVector(size()));}
+
+    // append a sample, its missing features are 0
+    void add(const XY& xy)
+    {
+        if (xy.get_x_size() > X_.size())
+            resize_x(xy.get_x_size());
+        for (size_t j=0, s=X_.size(); j<s; j++)
+            X_[j].push_back(j < xy.get_x_size() ? xy.x(j) : CompoundValue());
+        y_.push_back(xy.Y());
+#if !defined DISABLE_WEIGHT
+        weights_.push_back(xy.weight());
+#endif
+    }
+
+    // append a sample of numerical features x[0, x_size) without an XY,
+    // call finalize after the last one
+    void add(const double * x, size_t x_size, double y, double weight = 1.0)
+    {
+        if (x_size > X_.size())
+            resize_x(x_size);
+        for (size_t j=0, s=X_.size(); j<s; j++)
+        {
+            CompoundValue value;
+            if (j < x_size)
+                value.d() = x[j];
+            X_[j].push_back(value);
+        }
+        CompoundValue Y;
+        Y.d() = y;
+        y_.push_back(Y);
+#if !defined DISABLE_WEIGHT
+        weights_.push_back(weight);
+#endif
+    }
+
+    // for samples added by add(x, x_size, y, weight):
+    // make all features numerical and compute x values and bins as loaders do,
+    // return -1 if there is no sample
+    int finalize();
+
+    void reserve(size_t size)
+    {
+        for (size_t j=0, s=X_.size(); j<s; j++)
+            X_[j].reserve(size);
+        y_.reserve(size);
+#if !defined DISABLE_WEIGHT
+        weights_.reserve(size);
+#endif
+    }
 
     void clear()
     {
         spec_.clear();
-        samples_.clear();
+        x_values_.clear();
+        x_bins_.clear();
+        X_.clear();
+        y_.clear();
+#if !defined DISABLE_WEIGHT
+        weights_.clear();
+#endif
     }
 };
 
-// external reference to a set of training samples
+// external reference to a subset of training samples
 class XYSetRef
 {
 private:
-    // training sample specifications
-    const XYSpec * spec_;
-    // x_values_[i] is a collection of pre-sorted x values of the ith feature.
-    // It is used when tree is being split.
-    const std::vector<CompoundValueVector> * x_values_;
-    // training samples
-    std::vector<const XY *> samples_;
+    // training samples, specifications and
+    // pre-sorted x values used when tree is being split
+    const XYSet * full_set_;
+    // rows_[i] is the index of the ith sample in 'full_set_'
+    std::vector<uint32_t> rows_;
 
 public:
     XYSetRef() {clear();}
 
-    const XYSpec *& spec() {return spec_;}
-    const XYSpec * spec() const {return spec_;}
+    const XYSet *& full_set() {return full_set_;}
+    const XYSet * full_set() const {return full_set_;}
+
+    const std::vector<uint32_t>& rows() const {return rows_;}
 
-    const std::vector<CompoundValueVector> *& x_values() {return x_values_;}
-    const std::vector<CompoundValueVector> * x_values() const {return x_values_;}
+    size_t get_x_type_size() const {return full_set_->get_x_type_size();}
+    kXType get_x_type(size_t i) const {return full_set_->get_x_type(i);}
 
-    std::vector<const XY *>& sample() {return samples_;}
-    const std::vector<const XY *>& sample() const {return samples_;}
+    size_t get_x_values_size() const {return full_set_->get_x_values_size();}
+    const CompoundValueVector& get_x_values(size_t i) const {return full_set_->get_x_values(i);}
 
-    size_t get_x_type_size() const {return spec_->get_x_type_size();}
-    kXType get_x_type(size_t i) const {return spec_->get_x_type(i);}
+    const XBinVector& get_x_bins(size_t i) const {return full_set_->get_x_bins(i);}
 
-    size_t get_x_values_size() const {return x_values_->size();}
-    const CompoundValueVector& get_x_values(size_t i) const {return (*x_values_)[i];}
+    size_t size() const {return rows_.size();}
+    uint32_t row(size_t i) const {return rows_[i];}
 
-    size_t size() const {return samples_.size();}
-    const XY& get(size_t i) const {return *samples_[i];}
+    // the ith sample
+    const CompoundValue& x(size_t i, size_t x_index) const {return full_set_->x(rows_[i], x_index);}
+    double y(size_t i) const {return full_set_->y(rows_[i]);}
+    size_t label(size_t i) const {return full_set_->label(rows_[i]);}
+    double weight(size_t i) const {return full_set_->weight(rows_[i]);}
 
     void load(const XYSet& set)
     {
-        spec_ = &set.spec();
-        x_values_ = &set.x_values();
-        samples_.clear();
-        for (size_t i=0, s=set.size(); i<s; i++)
-            add(set.get(i));
+        load(set, set.size());
     }
 
-    void add(const XY& xy)
+    // the first 'size' samples of 'set'
+    void load(const XYSet& set, size_t size)
     {
-        samples_.push_back(&xy);
+        full_set_ = &set;
+        rows_.resize(size);
+        for (size_t i=0; i<size; i++)
+            rows_[i] = (uint32_t)i;
+    }
+
+    void add(uint32_t row)
+    {
+        rows_.push_back(row);
     }
 
     void clear()
     {
-        spec_ = 0;
-        x_values_ = 0;
-        samples_.clear();
+        full_set_ = 0;
+        rows_.clear();
     }
 };
 
@@ -222,4 +313,10 @@ int load_gbdt(const char * filename, XYSet * set);
 // http://research.microsoft.com/en-us/um/beijing/projects/letor//letor4dataset.aspx
 int load_lector4(const char * filename, XYSet * set, std::vector<size_t> * n_samples_per_query);
 
+// keep at most 'max_x_values' evenly spaced x values of every numerical feature
+// as split candidates and bin all samples, for histogram training
+void limit_x_values(XYSet * set, size_t max_x_values);
+// whether all samples are binned, in at most 'max_x_values' bins per numerical feature
+bool x_values_limited(const XYSet& set, size_t max_x_values);
+
 #endif// GBDT_TRAINING_SAMPLE_H
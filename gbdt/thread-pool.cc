@@ -0,0 +1,89 @@
+#include "thread-pool.h"
+#include <assert.h>
+
+ThreadPool::ThreadPool(size_t thread_number)
+    : stop_(false), generation_(0), task_(0), n_(0), next_(0), active_(0)
+{
+    for (size_t i=1; i<thread_number; i++)
+        workers_.push_back(std::thread(&ThreadPool::worker_main, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (size_t i=0, s=workers_.size(); i<s; i++)
+        workers_[i].join();
+}
+
+void ThreadPool::work()
+{
+    for (;;)
+    {
+        size_t i = next_.fetch_add(1);
+        if (i >= n_)
+            return;
+        (*task_)(i);
+    }
+}
+
+void ThreadPool::worker_main()
+{
+    size_t generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [&] {return stop_ || generation_ != generation;});
+            if (stop_)
+                return;
+            generation = generation_;
+        }
+
+        work();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--active_ == 0)
+                finish_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)>& task)
+{
+    if (workers_.empty() || n <= 1)
+    {
+        for (size_t i=0; i<n; i++)
+            task(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        assert(active_ == 0);
+        task_ = &task;
+        n_ = n;
+        next_ = 0;
+        active_ = workers_.size();
+        generation_++;
+    }
+    start_.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    finish_.wait(lock, [&] {return active_ == 0;});
+    task_ = 0;
+}
+
+void ThreadPool::parallel_for_range(size_t n, const std::function<void(size_t, size_t)>& task)
+{
+    size_t ranges = size();
+    if (ranges > n)
+        ranges = n;
+    parallel_for(ranges, [&](size_t i) {task(i * n / ranges, (i + 1) * n / ranges);});
+}
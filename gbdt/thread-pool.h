@@ -0,0 +1,48 @@
+#ifndef GBDT_THREAD_POOL_H
+#define GBDT_THREAD_POOL_H
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed group of worker threads running one parallel loop at a time.
+// The calling thread takes part in every loop,
+// so a pool of 1 thread has no worker and runs loops inline.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable finish_;
+    bool stop_;
+    // the running loop
+    size_t generation_;
+    const std::function<void(size_t)> * task_;
+    size_t n_;
+    std::atomic<size_t> next_;
+    size_t active_;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+    void work();
+    void worker_main();
+
+public:
+    explicit ThreadPool(size_t thread_number);
+    ~ThreadPool();
+
+    size_t size() const {return workers_.size() + 1;}
+
+    // call 'task(i)' for every i in [0, n) and wait for all of them
+    void parallel_for(size_t n, const std::function<void(size_t)>& task);
+    // split [0, n) into at most size() contiguous ranges,
+    // call 'task(begin, end)' for every range and wait for all of them
+    void parallel_for_range(size_t n, const std::function<void(size_t, size_t)>& task);
+};
+
+#endif// GBDT_THREAD_POOL_H
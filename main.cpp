@@ -2,25 +2,122 @@
 #include <strstream>
 #include <unistd.h>
 #include <filesystem>
+#include <thread>
 
 #include "flags/flags.h"
 #include "gbdt/x.h"
 #include "gbdt/gbdt.h"
 #include "mexc/mexc.hpp"
+#include "mexc/mexc_backtest.hpp"
+#include "mexc/mexc_features.hpp"
+#include "mexc/mexc_history.hpp"
+#include "mexc/mexc_orderbook.hpp"
+#include "mexc/mexc_replay.hpp"
+#include "mexc/mexc_retrainer.hpp"
+#include "mexc/mexc_scheduler.hpp"
+#include "mexc/mexc_service.hpp"
+#include "mexc/mexc_stream.hpp"
+#include "mexc/mexc_stub_server.hpp"
+#include "mexc/mexc_sweep.hpp"
+
+// BUY over 0.5, SELL under -0.5, replacing the last order 'idPos';
+// orders are only printed if not 'send'
+void trade(MexcApi &c, const std::string &symbol, double res, std::string &idPos, bool send) {
+    if (res > 0.5) {
+        std::cout << "BUY" << std::endl;
+        if (!send) return;
+        if (idPos != "" ) c.cancelOrder(symbol.c_str(), idPos);
+        auto r = c.sendOrder(symbol.c_str(), "BUY", "MARKET", 1.0);
+        if (c.error() == 0) {
+            idPos = r.orderId;
+        }
+        else std::cout << c.errorString() << std::endl;
+    }
+    else if (res < -0.5) {
+        std::cout << "SELL" << std::endl;
+        if (!send) return;
+        if (idPos != "" ) c.cancelOrder(symbol.c_str(), idPos);
+        auto r = c.sendOrder(symbol.c_str(), "SELL", "MARKET", 1.0);
+        if (c.error() == 0) {
+            idPos = r.orderId;
+        }
+        else std::cout << c.errorString() << std::endl;
+    }
+}
+
+// the binary model if it exists, the JSON one otherwise
+int loadModel(GBDTPredictor &predictor, const char *binary_model, const char *json_model, GBDTPredictor::kEngine engine) {
+    if (std::filesystem::exists(binary_model))
+        return predictor.load_binary(binary_model, engine);
+    FILE * input1 = xfopen(json_model, "r");
+    int ret = predictor.load_json(input1, engine);
+    fclose(input1);
+    return ret;
+}
 
-std::vector<double> SMA(std::vector<double> &data, int period) {
-    std::vector<double> sma(data.size(), 0.0);
-    double sum = 0;
-    for (int i = 0; i < period; i++) {
-        sum += data[i];
+// bars of data/SYMBOL_PERIOD.klines, after downloading those of the last
+// 'days' days missing from it (none if 'days' is 0)
+bool openHistory(MexcApi &c, KlineStore &store, const std::string &symbol, const std::string &period, int days) {
+    std::string dir = "data/" + symbol + "_" + period + ".klines";
+    if (!store.open(dir)) {
+        std::cerr << "Can not open " << dir << std::endl;
+        return false;
     }
-    sma[period - 1] = sum / period;
-    for (int i = period; i < data.size(); i++) {
-        sum -= data[i - period];
-        sum += data[i];
-        sma[i] = sum / period;
+    if (days == 0)
+        return true;
+    int64_t start = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count()
+                    - days * 86400000LL;
+    return KlineHistory::download(c, store, symbol, period, start) != -1;
+}
+
+// Concurrent getKlinesAsync requests and the retries of those answered
+// 429, against a local stub server, return the number of failed checks.
+int checkAsync() {
+    // responses take 200 ms
+    MexcStubServer server(200);
+    server.route("/api/v3/klines", "[[1700000000000,\"1.0\",\"2.0\",\"0.5\",\"1.5\",\"100\",1700000059999,\"150\"]]");
+    if (!server.start()) {
+        std::cerr << "Can not start the stub server" << std::endl;
+        return 1;
     }
-    return sma;
+    MexcApi c("", "", server.url());
+
+    int failed = 0;
+    auto check = [&](bool ok, const char *what) {
+        printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+        failed += !ok;
+    };
+
+    // run 'n' requests, return the seconds they took, all decoded if 'good' is n
+    int good = 0;
+    auto run = [&](int n) {
+        good = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; i++) {
+            c.getKlinesAsync("BTCUSDT", "1m", 0, 0, 1, [&](Klines &res, int code, const std::string &) {
+                good += code == 0 && res.size() == 1 && res[0].close == 1.5;
+            });
+        }
+        size_t left = c.runAsync(10000);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%d requests in %.2lf s, %zu left\n", n, elapsed, left);
+        return elapsed;
+    };
+
+    double elapsed = run(8);
+    check(good == 8, "concurrent requests decoded");
+    check(server.maxConcurrent() > 1, "requests overlap");
+    check(elapsed < 8 * 0.2, "faster than one after the other");
+
+    // the first two answered 429 with Retry-After: 1
+    server.throttle(2, 1);
+    size_t before = server.requests();
+    elapsed = run(4);
+    check(good == 4, "throttled requests retried");
+    check(server.requests() - before == 6, "each throttled request requeued once");
+    check(elapsed >= 1.0, "retries wait for Retry-After");
+    check(c.rateLimiter().stats().throttled == 2, "429 responses counted");
+    return failed;
 }
 
 int main(int argc, char** argv) {
@@ -41,18 +138,9 @@ int main(int argc, char** argv) {
     param.model = "train.json";
     param.gbdt_sample_rate = 0.9;
     param.gbdt_loss = "ls";
-
-    const auto symbol = args.get<std::string>("symbol");
-    if (!symbol) {
-        std::cerr << "No symbol" << std::endl;
-        return 1;
-    }
-
-    const auto period = args.get<std::string>("period");
-    if (!period) {
-        std::cerr << "No period" << std::endl;
-        return 1;
-    }
+    param.gbdt_histogram_bins = 0;
+    param.gbdt_histogram_subtraction = 1;
+    param.num_threads = 1;
 
     const auto verbose = args.get<int>("verbose");
     if (!verbose) param.verbose = 1;
@@ -78,190 +166,356 @@ int main(int argc, char** argv) {
     if (!learning_rate) param.learning_rate = 0.1;
     else param.learning_rate = learning_rate.value();
 
-    std::strstream training_sample;
-    training_sample << "data/" << symbol.value().c_str() << "_" << period.value().c_str() << "_train.dat" << std::ends;
+    const auto histogram_bins = args.get<size_t>("histogram_bins");
+    if (!histogram_bins) param.gbdt_histogram_bins = 0;
+    else param.gbdt_histogram_bins = histogram_bins.value();
 
-    std::strstream model;
-    model << "data/" << symbol.value().c_str() << "_" << period.value().c_str() << "_model.dat" << std::ends;
+    const auto histogram_subtraction = args.get<int>("histogram_subtraction");
+    if (!histogram_subtraction) param.gbdt_histogram_subtraction = 1;
+    else param.gbdt_histogram_subtraction = histogram_subtraction.value();
 
-    param.training_sample = training_sample.str();
-    param.model = model.str();
+    const auto num_threads = args.get<size_t>("num_threads");
+    if (!num_threads) param.num_threads = std::thread::hardware_concurrency();
+    else param.num_threads = num_threads.value();
 
-    MexcApi c("", "");
+    const auto quick_scorer = args.get<bool>("quick_scorer");
+    GBDTPredictor::kEngine engine = GBDTPredictor::kEngine_FlatTrees;
+    if (quick_scorer && quick_scorer.value()) engine = GBDTPredictor::kEngine_QuickScorer;
 
     int input = 10;
     int inputSma = 15;
     int max = 25;
 
-    const auto train = args.get<bool>("train");
-    if (train) {
-        auto candles = c.getKlines(symbol.value(), period.value(), 0, 0, 1000);
-        if (c.error() != 0) {
-            std::cout << c.errorString() << std::endl;
-            return 2;
-        }
+    const auto check_async = args.get<bool>("check_async");
+    if (check_async)
+        return checkAsync() ? 1 : 0;
 
-        std::vector<double> closes;
+    // signals of every model of a directory, in one process
+    const auto service = args.get<std::string>("service");
+    if (service) {
+        ModelRegistry models;
+        if (models.load(service.value(), engine) == -1)
+            return 2;
 
-        for (auto &item : candles)
-            closes.push_back(item.close);
+        MexcApi c("", "");
+        MexcService mexcService(c, models, input, inputSma, param.num_threads);
+        mexcService.addAll();
+        std::cout << mexcService.size() << " symbols, " << models.distinct() << " models" << std::endl;
+
+        std::map<std::string, std::string> idPos;
+        mexcService.onSignal([&](const std::string &symbol, const std::string &, double res) {
+            printf("%s %lf\n", symbol.c_str(), res);
+            trade(c, symbol, res, idPos[symbol], true);
+        });
+        mexcService.warmUp();
+        mexcService.run();
+        return 0;
+    }
 
-        auto sma = SMA(closes, inputSma);
+    const auto symbol = args.get<std::string>("symbol");
+    if (!symbol) {
+        std::cerr << "No symbol" << std::endl;
+        return 1;
+    }
 
-        std::string in;
+    const auto period = args.get<std::string>("period");
+    if (!period) {
+        std::cerr << "No period" << std::endl;
+        return 1;
+    }
 
-        std::ofstream data_file(training_sample.str());
+    std::strstream model;
+    model << "data/" << symbol.value().c_str() << "_" << period.value().c_str() << "_model.dat" << std::ends;
 
-        for (int i = (input + inputSma); i < closes.size() - max; i++)
-        {
-            in.clear();
+    std::strstream binary_model;
+    binary_model << "data/" << symbol.value().c_str() << "_" << period.value().c_str() << "_model.bin" << std::ends;
 
-            auto h = i + rand() % max;
+    param.model = model.str();
 
-            if (closes[h] > closes[i])
-            {
-                in += "+1";
-            }
-            else
-            {
-                if (closes[h] < closes[i])
-                {
-                    in += "-1";
-                }
-                else
-                {
-                    in += "-1";
-                }
-            }
+    const auto convert_model = args.get<bool>("convert_model");
+    if (convert_model) {
+        GBDTPredictor predictor;
+        FILE * input1 = xfopen(param.model.c_str(), "r");
+        int ret = predictor.load_json(input1);
+        fclose(input1);
+        if (ret == -1)
+            return 2;
 
-            in += " ";
+        FILE * output = xfopen(binary_model.str(), "wb");
+        ret = predictor.save_binary(output);
+        fclose(output);
+        return ret == -1 ? 2 : 0;
+    }
 
-            in += "1:";
-            in += std::to_string(closes[i]);
+    MexcApi c("", "");
 
-            for (int j = 0; j < input; j++)
-            {
-                in += " ";
+    const auto train = args.get<bool>("train");
+    const auto backtest = args.get<bool>("backtest");
+    const auto replay_orderbook = args.get<std::string>("replay_orderbook");
+    if (train) {
+        std::vector<double> closes;
 
-                in += std::to_string(j+2);
-                in += ":";
-                in += std::to_string(sma[i - j]);
+        // bars are kept in data/SYMBOL_PERIOD.klines, only the missing tail is downloaded
+        const auto history_days = args.get<int>("history_days");
+        if (history_days) {
+            KlineStore store;
+            if (!openHistory(c, store, symbol.value(), period.value(), history_days.value()))
+                return 2;
+            closes.assign(store.closes(), store.closes() + store.size());
+        }
+        else {
+            auto candles = c.getKlines(symbol.value(), period.value(), 0, 0, 1000);
+            if (c.error() != 0) {
+                std::cout << c.errorString() << std::endl;
+                return 2;
             }
 
-            data_file << in << "\n";
+            for (auto &item : candles)
+                closes.push_back(item.close);
         }
 
-        data_file.close();
-
+        size_t columns = input + 1;
+        std::vector<double> rows;
         XYSet set;
-        if (param.training_sample_format == "liblinear")
-        {
-            if (load_liblinear(param.training_sample.c_str(), &set) == -1)
-                return 2;
-        }
-        else
-        {
-            if (load_gbdt(param.training_sample.c_str(), &set) == -1)
-                return 2;
+        if (makeTrainingSet(closes.data(), closes.size(), input, inputSma, max, rows, set) == -1)
+            return 2;
+
+        if (param.gbdt_histogram_bins)
+            limit_x_values(&set, param.gbdt_histogram_bins);
+
+        // --sweep=N ranks N random configurations by walk-forward validation
+        // over --folds=K folds instead of training one
+        const auto sweep = args.get<size_t>("sweep");
+        if (sweep) {
+            const auto folds = args.get<size_t>("folds");
+            WalkForward walkForward(set, rows.data(), columns, folds ? folds.value() : 5, max, param.num_threads);
+            auto start = std::chrono::steady_clock::now();
+            auto results = walkForward.run(WalkForward::randomParams(param, sweep.value(), 1));
+            WalkForward::printLeaderboard(results, 20);
+            printf("%zu configurations in %.1lf s\n", results.size(),
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            return 0;
         }
 
         GBDTTrainer trainer(set, param);
-        trainer.train();
+        if (trainer.train() == -1)
+            return 2;
 
         FILE * output = xfopen(param.model.c_str(), "w");
         trainer.save_json(output);
         fclose(output);
 
-        GBDTPredictor predictor;
-        FILE * input1 = xfopen(param.model.c_str(), "r");
-        predictor.load_json(input1);
-        fclose(input1);
+        output = xfopen(binary_model.str(), "wb");
+        trainer.save_binary(output);
+        fclose(output);
+
+        std::vector<double> predicted(set.size());
+        trainer.predict_batch(rows.data(), set.size(), columns, predicted.data());
 
         for (size_t i=0, s=set.size(); i<s; i++)
-        {
-            const XY& xy = set.get(i);
-            const CompoundValueVector& X = xy.X();
-            double y = xy.y();
-            printf("%lf should be near to %lf\n", predictor.predict(X), y);
+            printf("%lf should be near to %lf\n", predicted[i], set.y(i));
+    }
+    else if (backtest) {
+        GBDTPredictor predictor;
+        if (loadModel(predictor, binary_model.str(), param.model.c_str(), engine) == -1)
+            return 2;
+
+        // the stored bars, --history_days=N downloads the missing ones first
+        const auto history_days = args.get<int>("history_days");
+        KlineStore store;
+        if (!openHistory(c, store, symbol.value(), period.value(), history_days ? history_days.value() : 0))
+            return 2;
+
+        double fee = 0;
+        auto info = c.getExchangeInfo(symbol.value());
+        if (c.error() == 0 && !info.symbols.empty())
+            fee = Backtest::takerFee(info.symbols[0]);
+        else
+            std::cout << "No fee: " << c.errorString() << std::endl;
+
+        Backtest tester(predictor, input, inputSma, fee, 1.0, 0.5, param.num_threads);
+        auto start = std::chrono::steady_clock::now();
+        BacktestReport report = tester.run(store);
+        double elapsed = duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1e6;
+
+        printf("bars %zu (%.0f per second)\n", store.size(), elapsed > 0 ? store.size() / elapsed : 0);
+        printf("signals %zu, trades %zu, rejected %zu, fee %lf\n", report.signals, report.trades, report.rejected, fee);
+        printf("pnl %lf, fees %lf, max drawdown %lf, hit rate %.2lf%% of %zu\n",
+               report.pnl, report.fees, report.max_drawdown, report.hitRate() * 100, report.closing);
+    }
+    else if (replay_orderbook) {
+        // the scales the depth messages are decoded with
+        auto info = c.getExchangeInfo(symbol.value());
+        if (c.error() != 0 || info.symbols.empty()) {
+            std::cout << "No symbol info: " << c.errorString() << std::endl;
+            return 2;
+        }
+        FixedScale scale;
+        if (!FixedScale::fromSymbol(info.symbols[0], scale)) {
+            std::cerr << "Unsupported precision of " << symbol.value() << std::endl;
+            return 2;
         }
+
+        OrderBooks books(NULL);
+        books.add(symbol.value(), scale);
+        auto start = std::chrono::steady_clock::now();
+        size_t messages = books.replay(replay_orderbook.value());
+        double elapsed = duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1e6;
+
+        OrderBook *book = books.book(symbol.value());
+        printf("messages %zu (%.0f per second)\n", messages, elapsed > 0 ? messages / elapsed : 0);
+        printf("version %lld, %s, %zu bids, %zu asks\n", (long long)book->version(),
+               book->isSynced() ? "synced" : "out of sync", book->bidSize(), book->askSize());
     }
     else {
-        GBDTPredictor predictor;
-        FILE * input1 = xfopen(param.model.c_str(), "r");
-        predictor.load_json(input1);
-        fclose(input1);
+        std::shared_ptr<GBDTPredictor> predictor(new GBDTPredictor);
+        if (loadModel(*predictor, binary_model.str(), param.model.c_str(), engine) == -1)
+            return 2;
+
+        // --retrain_every=N retrains on the last 1000 bars every N bars in the
+        // background and swaps the new model in
+        const auto retrain_every = args.get<int>("retrain_every");
+        if (retrain_every && retrain_every.value() <= 0) {
+            std::cerr << "--retrain_every must be positive" << std::endl;
+            return 1;
+        }
+        Retrainer retrainer(param, input, inputSma, max, retrain_every ? retrain_every.value() : 0, 1000,
+                            binary_model.str());
+        retrainer.publish(predictor);
+        predictor.reset();
 
         std::string idPos = "";
-        int64_t lastBar = 0;
 
-        while (true) {
-            auto bars = c.getKlines(symbol.value(), period.value(), 0, 0, 50);
-            if(bars.back().open_time != lastBar) {
-                lastBar = bars.back().open_time;
-                std::vector<double> closes;
+        // signals are only printed when replaying recorded messages
+        const auto replay = args.get<std::string>("replay");
+        bool sendOrders = !replay;
 
-                for (auto &kline : bars)
-                    closes.push_back(kline.close);
+        Features features(input, inputSma);
+        std::vector<double> row(features.size());
 
-                auto sma = SMA(closes, inputSma);
+        // called with each closed bar, 'signal' for the bar that just closed;
+        // bars caught up after a gap only update the features and the history
+        auto onBar = [&](double close, bool signal) {
+            if (features.update(close) && signal) {
+                features.get(row.data());
 
-                std::string in1;
-                in1 += "+1 1:";
-                in1 += std::to_string(closes.back());
+                double res;
+                retrainer.model()->predict_batch(row.data(), 1, row.size(), &res);
+                printf("%lf\n", res);
 
-                for (int j = 0; j < input; j++) {
-                    in1 += " ";
-                    in1 += std::to_string(j+2);
-                    in1 += ":";
-                    in1 += std::to_string(sma[closes.size() - j - 1]);
-                }
+                trade(c, symbol.value(), res, idPos, sendOrders);
+            }
+
+            if (retrain_every)
+                retrainer.onBar(close);
+        };
+
+        // bars before the first signal, the retraining history when retraining
+        int warmUpBars = retrain_every ? 1000 : 50;
+        auto warmUp = [&](double close) {
+            features.update(close);
+            retrainer.addHistory(close);
+        };
+
+        const auto stream = args.get<bool>("stream");
+        if (stream || replay) {
+            std::unique_ptr<MexcReplayServer> server;
+            std::string url = WS_ENDPOINT;
+            if (replay) {
+                server.reset(new MexcReplayServer(replay.value(), 10));
+                if (!server->start())
+                    return 2;
+                url = server->url();
+            }
 
-                std::ofstream data_file1(param.training_sample.c_str());
-                data_file1 << in1;
-                data_file1.close();
+            // live bars close on the exchange clock, replayed ones on the next bar
+            MexcStream ws(url, replay ? NULL : &c);
+            ws.subscribeKlines(symbol.value(), period.value(), 500);
+            if (!replay) {
+                auto bars = c.getKlines(symbol.value(), period.value(), 0, 0, warmUpBars);
+                ws.seedKlines(symbol.value(), period.value(), bars);
+                // the last bar is still open
+                for (size_t i = 0; i + 1 < bars.size(); i++)
+                    warmUp(bars[i].close);
+            }
+
+            const auto record = args.get<std::string>("record");
+            if (record && !ws.record(record.value())) {
+                std::cerr << "Can not open " << record.value() << std::endl;
+                return 2;
+            }
 
-                XYSet set1;
-                if (param.training_sample_format == "liblinear")
-                {
-                    if (load_liblinear(param.training_sample.c_str(), &set1) == -1)
-                        return 2;
+            // --orderbook keeps the book of the symbol from the depth channel,
+            // its snapshots go to the --record file too
+            const auto orderbook = args.get<bool>("orderbook");
+            OrderBooks books(&c);
+            if (orderbook && !replay) {
+                auto info = c.getExchangeInfo(symbol.value());
+                if (c.error() != 0 || info.symbols.empty()) {
+                    std::cout << "No symbol info: " << c.errorString() << std::endl;
+                    return 2;
                 }
-                else
-                {
-                    if (load_gbdt(param.training_sample.c_str(), &set1) == -1)
-                        return 2;
+                FixedScale scale;
+                if (!FixedScale::fromSymbol(info.symbols[0], scale)) {
+                    std::cerr << "Unsupported precision of " << symbol.value() << std::endl;
+                    return 2;
                 }
+                books.add(symbol.value(), scale);
+                if (record && !books.record(record.value())) {
+                    std::cerr << "Can not open " << record.value() << std::endl;
+                    return 2;
+                }
+                ws.subscribeDepth(symbol.value());
+                ws.onDepthMessage([&](const std::string &, const std::string &message) {
+                    books.onDepthMessage(message);
+                });
+            }
 
-                for (size_t i=0, s=set1.size(); i<s; i++)
-                {
-                    const XY& xy = set1.get(i);
-                    const CompoundValueVector& X = xy.X();
-                    double y = xy.y();
-                    double res = predictor.predict(X);
-                    printf("%lf should be near to %lf\n", res, y);
-
-                    if (res > 0.5) {
-                        if (idPos != "" ) c.cancelOrder(symbol.value().c_str(), idPos);
-                        std::cout << "BUY" << std::endl;
-                        auto r = c.sendOrder(symbol.value().c_str(), "BUY", "MARKET", 1.0);
-                        if (c.error() == 0) {
-                            idPos = r.orderId;
-                        }
-                        else std::cout << c.errorString() << std::endl;
-                    }
-                    else if (res < -0.5) {
-                        if (idPos != "" ) c.cancelOrder(symbol.value().c_str(), idPos);
-                        std::cout << "SELL" << std::endl;
-                        auto r = c.sendOrder(symbol.value().c_str(), "SELL", "MARKET", 1.0);
-                        if (c.error() == 0) {
-                            idPos = r.orderId;
-                        }
-                        else std::cout << c.errorString() << std::endl;
-                    }
+            ws.onBarClose([&](const std::string &, const std::string &, const Kline &bar, bool latest) {
+                OrderBook *book = books.book(symbol.value());
+                if (latest && book && book->isSynced() && book->bidSize() && book->askSize()) {
+                    const FixedScale *scale = books.scale(symbol.value());
+                    printf("bid %lf ask %lf\n", FixedScale::toDouble(book->bid(0).price, scale->price),
+                           FixedScale::toDouble(book->ask(0).price, scale->price));
                 }
+                // bars of a gap only update the features
+                onBar(bar.close, latest);
+            });
+            // the replay server closes the connection once the file is played
+            if (replay)
+                ws.onClose([&] { ws.stop(); });
+            ws.run();
+            return 0;
+        }
+
+        // fetch the bars closed since the last one at each close
+        BarScheduler scheduler(&c);
+        int64_t lastBar = 0;
+        for (auto &kline : c.getKlines(symbol.value(), period.value(), 0, 0, warmUpBars)) {
+            if (kline.close_time >= scheduler.serverNow())
+                break;
+            warmUp(kline.close);
+            lastBar = kline.open_time;
+        }
+
+        bool added = scheduler.add(symbol.value(), period.value(), [&](const std::string &, const std::string &, int64_t openTime) {
+            // the latest bars if none is known yet, as after a failed warm-up:
+            // bars after startTime 1 are those of the listing
+            auto bars = c.getKlines(symbol.value(), period.value(), lastBar ? lastBar + 1 : 0, 0, 50);
+            if (c.error() != 0)
+                std::cout << c.errorString() << std::endl;
+            for (auto &kline : bars) {
+                if (kline.open_time > openTime)
+                    break;
+                lastBar = kline.open_time;
+                onBar(kline.close, kline.open_time == openTime);
             }
-            sleep(30);
+        });
+        if (!added) {
+            std::cerr << "Unsupported period " << period.value() << std::endl;
+            return 1;
         }
+        scheduler.run();
     }
 
     return 0;
@@ -3,7 +3,12 @@
 
 #include <iostream>
 #include <vector>
+#include <deque>
 #include <chrono>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <math.h>
 #include <stdlib.h>
 #include <sys/time.h>
 #include <curl/curl.h>
@@ -11,6 +16,8 @@
 #include <openssl/evp.h>
 #include <openssl/bn.h>
 #include <nlohmann/json.hpp>
+#include "mexc_decode.hpp"
+#include "mexc_ratelimit.hpp"
 #include <mbedtls/sha256.h>
 #include <mbedtls/md.h>
 
@@ -95,7 +102,8 @@ struct DepthPrice {
 };
 
 struct Trade {
-    nlohmann::json id;
+    // 0 if the exchange gives none
+    int64_t id;
     std::string price;
     std::string qty;
     std::string quoteQty;
@@ -110,9 +118,10 @@ struct Trade {
 using Trades = std::vector<Trade>;
 
 struct AggTrade {
-    nlohmann::json a;
-    nlohmann::json f;
-    nlohmann::json l;
+    // 0 if the exchange gives none
+    int64_t a;
+    int64_t f;
+    int64_t l;
     std::string p;
     std::string q;
     int64_t T;
@@ -214,6 +223,103 @@ struct OrderClode {
                                    cummulativeQuoteQty, status, timeInForce, type, side)
 };
 
+// Numeric market data: prices and quantities are fixed-point integers,
+// value * 10^scale, with the scales of the symbol from ExchangeInfo.
+struct FixedScale {
+    // digits after the point of prices, base asset quantities and quote asset amounts
+    int price;
+    int qty;
+    int quote;
+
+    // 10^18 is the largest power of 10 in int64_t
+    static const int MAX_SCALE = 18;
+
+    // false if a precision of the symbol is not in 0..MAX_SCALE
+    static bool fromSymbol(const Symbol &symbol, FixedScale &res) {
+        res = {symbol.quotePrecision, symbol.baseAssetPrecision, symbol.quoteAssetPrecision};
+        return isValid(res.price) && isValid(res.qty) && isValid(res.quote);
+    }
+
+    static bool isValid(int scale) {
+        return scale >= 0 && scale <= MAX_SCALE;
+    }
+
+    // 'scale' in 0..MAX_SCALE
+    static double toDouble(int64_t value, int scale) {
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                        1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+        return value / powers[scale];
+    }
+
+    static int64_t fromDouble(double value, int scale) {
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                        1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+        return llround(value * powers[scale]);
+    }
+};
+
+struct FixedLevel {
+    int64_t price;
+    int64_t qty;
+};
+
+struct FixedDepth {
+    int64_t lastUpdateId;
+    // best first
+    std::vector<FixedLevel> bids;
+    std::vector<FixedLevel> asks;
+};
+
+struct FixedTrade {
+    // 0 if the exchange gives none
+    int64_t id;
+    int64_t price;
+    int64_t qty;
+    int64_t quoteQty;
+    int64_t time;
+    bool isBuyerMaker;
+    bool isBestMatch;
+    // tradeType is "BID"
+    bool isBid;
+};
+
+using FixedTrades = std::vector<FixedTrade>;
+
+struct FixedAvgPrice {
+    int mins;
+    int64_t price;
+};
+
+struct Fixed24hr {
+    int64_t priceChange;
+    double priceChangePercent;
+    int64_t prevClosePrice;
+    int64_t lastPrice;
+    int64_t bidPrice;
+    int64_t bidQty;
+    int64_t askPrice;
+    int64_t askQty;
+    int64_t openPrice;
+    int64_t highPrice;
+    int64_t lowPrice;
+    int64_t volume;
+    int64_t quoteVolume;
+    int64_t openTime;
+    int64_t closeTime;
+    int64_t count;
+};
+
+struct FixedBookTicker {
+    int64_t bidPrice;
+    int64_t bidQty;
+    int64_t askPrice;
+    int64_t askQty;
+};
+
+struct FixedPrice {
+    int64_t price;
+};
+
 class QueryParams
 {
     std::vector<std::string> params;
@@ -266,31 +372,59 @@ public:
 
     std::string to_str() {
         std::string ret;
-        for (auto i = 0; i < params.size(); ++i) {
+        to_str(ret);
+        return ret;
+    }
+
+    // write the query string to 'ret', reusing its storage
+    void to_str(std::string &ret) const {
+        ret.clear();
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (i != 0)
+                ret += '&';
             ret += params[i];
-            if (i != params.size() - 1)
-                ret += "&";
         }
-        return ret;
     }
 };
 
 class MexcApi
 {
 public:
-    MexcApi(std::string api_key, std::string secret_key) :
+    MexcApi(std::string api_key, std::string secret_key, std::string endpoint = API_ENDPOINT) :
         api_key_header{API_KEY_HEADER},
-        endpoint{API_ENDPOINT} {
+        endpoint{endpoint} {
         this->api_key = api_key;
         this->secret_key = secret_key;
+        errorCode = 0;
+        mbedtls_md_init(&hmac_ctx);
+        initHmac();
+        initCurl();
+        warmUp();
     }
 
     ~MexcApi() {
+        cleanupCurl();
+        mbedtls_md_free(&hmac_ctx);
     }
 
+    MexcApi(const MexcApi &) = delete;
+    MexcApi &operator=(const MexcApi &) = delete;
+
     void setApiKeys(std::string api_key, std::string secret_key) {
         this->api_key = api_key;
         this->secret_key = secret_key;
+        initHmac();
+        buildHeaders();
+    }
+
+    // open the connections of both handles, so the first request and the
+    // first order do not pay for DNS, TCP connect and TLS handshake
+    void warmUp() {
+        std::string url = endpoint + "/api/v3/ping";
+        startCurl(url, "", public_headers, Action::GET_ACTION);
+        startCurl(curl_private, url, "", private_headers, Action::GET_ACTION);
+        errorCode = 0;
+        errorStr = "";
     }
 
 public:
@@ -320,7 +454,7 @@ public:
 public:
     bool ping() {
         std::string url = endpoint + "/api/v3/ping";
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
         if (res_curl == CURLE_OK && curl_buffer == "{}") return true;
         else return false;
@@ -328,7 +462,7 @@ public:
 
     uint64_t getTime() {
         std::string url = endpoint + "/api/v3/time";
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
         if (res_curl == CURLE_OK) {
             nlohmann::json result;
@@ -342,7 +476,7 @@ public:
 
     std::vector<std::string> getDefaultSymbols() {
         std::string url = endpoint + "/api/v3/defaultSymbols";
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
         std::vector<std::string> res;
 
@@ -362,7 +496,7 @@ public:
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         std::string url = endpoint + "/api/v3/exchangeInfo?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
         ExchangeInfo res;
 
@@ -379,71 +513,75 @@ public:
     }
 
     DepthPrice getDepth(std::string symbol = "", int limit = 0) {
+        DepthPrice res;
+        getDepth(res, symbol, limit);
+        return res;
+    }
+
+    // fill 'res', reusing its storage
+    bool getDepth(DepthPrice &res, std::string symbol, int limit = 0) {
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         query_params.add_new_query("limit", limit);
         std::string url = endpoint + "/api/v3/depth?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
-        DepthPrice res;
+        if (res_curl == CURLE_OK)
+            parseResult(curl_buffer, res, errorCode, errorStr);
 
-        if (res_curl == CURLE_OK) {
-            nlohmann::json result;
-            if (nlohmann::json::accept(curl_buffer)) {
-                result = nlohmann::json::parse(curl_buffer);
-                parceError(result);
-                if (errorCode == 0) res = result.get<DepthPrice>();
-            }
-        }
+        return errorCode == 0;
+    }
 
+    Trades getTrades(std::string symbol = "", int limit = 0) {
+        Trades res;
+        getTrades(res, symbol, limit);
         return res;
     }
 
-    Trades getTrades(std::string symbol = "", int limit = 0) {
+    // fill 'res', reusing its storage
+    bool getTrades(Trades &res, std::string symbol, int limit = 0) {
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         query_params.add_new_query("limit", limit);
         std::string url = endpoint + "/api/v3/trades?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
-        Trades res;
+        if (res_curl == CURLE_OK)
+            parseResult(curl_buffer, res, errorCode, errorStr);
 
-        if (res_curl == CURLE_OK) {
-            nlohmann::json result;
-            if (nlohmann::json::accept(curl_buffer)) {
-                result = nlohmann::json::parse(curl_buffer);
-                parceError(result);
-                if (errorCode == 0) res = result.get<Trades>();
-            }
-        }
+        return errorCode == 0;
+    }
 
+    AggTrades getAggTrades(std::string symbol = "", long startTime = 0, long endTime = 0, int limit = 0) {
+        AggTrades res;
+        getAggTrades(res, symbol, startTime, endTime, limit);
         return res;
     }
 
-    AggTrades getAggTrades(std::string symbol = "", long startTime = 0, long endTime = 0, int limit = 0) {
+    // fill 'res', reusing its storage
+    bool getAggTrades(AggTrades &res, std::string symbol, long startTime = 0, long endTime = 0, int limit = 0) {
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         query_params.add_new_query("startTime", startTime);
         query_params.add_new_query("endTime", endTime);
         query_params.add_new_query("limit", limit);
         std::string url = endpoint + "/api/v3/aggTrades?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
-        AggTrades res;
+        if (res_curl == CURLE_OK)
+            parseResult(curl_buffer, res, errorCode, errorStr);
 
-        if (res_curl == CURLE_OK) {
-            nlohmann::json result;
-            if (nlohmann::json::accept(curl_buffer)) {
-                result = nlohmann::json::parse(curl_buffer);
-                parceError(result);
-                if (errorCode == 0) res = result.get<AggTrades>();
-            }
-        }
+        return errorCode == 0;
+    }
 
+    Klines getKlines(std::string symbol = "", std::string interval = "", long startTime = 0, long endTime = 0, int limit = 0) {
+        Klines res;
+        getKlines(res, symbol, interval, startTime, endTime, limit);
         return res;
     }
 
-    Klines getKlines(std::string symbol = "", std::string interval = "", long startTime = 0, long endTime = 0, int limit = 0) {
+    // fill 'res', reusing its storage
+    bool getKlines(Klines &res, std::string symbol, std::string interval, long startTime = 0, long endTime = 0, int limit = 0) {
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         query_params.add_new_query("interval", interval);
@@ -451,40 +589,19 @@ public:
         query_params.add_new_query("endTime", endTime);
         query_params.add_new_query("limit", limit);
         std::string url = endpoint + "/api/v3/klines?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
-        Klines res;
+        if (res_curl == CURLE_OK)
+            parseKlines(curl_buffer, res, errorCode, errorStr);
 
-        if (res_curl == CURLE_OK) {
-            nlohmann::json result;
-            if (nlohmann::json::accept(curl_buffer)) {
-                result = nlohmann::json::parse(curl_buffer);
-                parceError(result);
-                if (errorCode == 0) {
-                    for (int i=0;i<result.size();i++) {
-                        Kline item;
-                        item.open_time = result[i][0].get<uint64_t>();
-                        item.open   = std::stod(result[i][1].get<std::string>());
-                        item.high   = std::stod(result[i][2].get<std::string>());
-                        item.low    = std::stod(result[i][3].get<std::string>());
-                        item.close  = std::stod(result[i][4].get<std::string>());
-                        item.volume = std::stod(result[i][5].get<std::string>());
-                        item.close_time = result[i][6].get<uint64_t>();
-                        item.quote_asset_volume = std::stod(result[i][7].get<std::string>());
-                        res.push_back(item);
-                    }
-                }
-            }
-        }
-
-        return res;
+        return errorCode == 0;
     }
 
     AvgPrice getAvgPrice(std::string symbol = "") {
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         std::string url = endpoint + "/api/v3/avgPrice?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
         AvgPrice res;
 
@@ -504,7 +621,7 @@ public:
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         std::string url = endpoint + "/api/v3/ticker/24hr?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
         s24hr res;
 
@@ -524,7 +641,7 @@ public:
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         std::string url = endpoint + "/api/v3/ticker/price?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
         Price res;
 
@@ -544,22 +661,137 @@ public:
         QueryParams query_params;
         query_params.add_new_query("symbol", symbol);
         std::string url = endpoint + "/api/v3/ticker/bookTicker?" + query_params.to_str();
-        auto res_curl = startCurl(url, "", headr, Action::GET_ACTION);
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
 
         BookTicker res;
 
-        if (res_curl == CURLE_OK) {
-            nlohmann::json result;
-            if (nlohmann::json::accept(curl_buffer)) {
-                result = nlohmann::json::parse(curl_buffer);
-                parceError(result);
-                if (errorCode == 0) res = result.get<BookTicker>();
-            }
-        }
+        if (res_curl == CURLE_OK)
+            parseResult(curl_buffer, res, errorCode, errorStr);
 
         return res;
     }
 
+    // Numeric overloads filling caller-owned results, see FixedScale.
+    bool getDepth(FixedDepth &res, const FixedScale &scale, std::string symbol, int limit = 0) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        query_params.add_new_query("limit", limit);
+        std::string url = endpoint + "/api/v3/depth?" + query_params.to_str();
+        return getFixed(url, [&](const std::string &buffer) {return decodeDepth(buffer, scale, res);});
+    }
+
+    bool getTrades(FixedTrades &res, const FixedScale &scale, std::string symbol, int limit = 0) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        query_params.add_new_query("limit", limit);
+        std::string url = endpoint + "/api/v3/trades?" + query_params.to_str();
+        return getFixed(url, [&](const std::string &buffer) {return decodeTrades(buffer, scale, res);});
+    }
+
+    bool getAvgPrice(FixedAvgPrice &res, const FixedScale &scale, std::string symbol) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        std::string url = endpoint + "/api/v3/avgPrice?" + query_params.to_str();
+        return getFixed(url, [&](const std::string &buffer) {return decodeAvgPrice(buffer, scale, res);});
+    }
+
+    bool get24hr(Fixed24hr &res, const FixedScale &scale, std::string symbol) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        std::string url = endpoint + "/api/v3/ticker/24hr?" + query_params.to_str();
+        return getFixed(url, [&](const std::string &buffer) {return decode24hr(buffer, scale, res);});
+    }
+
+    bool getPrice(FixedPrice &res, const FixedScale &scale, std::string symbol) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        std::string url = endpoint + "/api/v3/ticker/price?" + query_params.to_str();
+        return getFixed(url, [&](const std::string &buffer) {return decodePrice(buffer, scale, res);});
+    }
+
+    bool getBookTicker(FixedBookTicker &res, const FixedScale &scale, std::string symbol) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        std::string url = endpoint + "/api/v3/ticker/bookTicker?" + query_params.to_str();
+        return getFixed(url, [&](const std::string &buffer) {return decodeBookTicker(buffer, scale, res);});
+    }
+
+    // Asynchronous requests: they are only started here, runAsync performs
+    // them concurrently on the calling thread and calls 'callback' with the
+    // result, the error code and the error string when each one is done.
+    using KlinesCallback = std::function<void(Klines &, int, const std::string &)>;
+    using DepthCallback = std::function<void(DepthPrice &, int, const std::string &)>;
+    using BookTickerCallback = std::function<void(BookTicker &, int, const std::string &)>;
+
+    void getKlinesAsync(std::string symbol, std::string interval, long startTime, long endTime, int limit,
+                        KlinesCallback callback) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        query_params.add_new_query("interval", interval);
+        query_params.add_new_query("startTime", startTime);
+        query_params.add_new_query("endTime", endTime);
+        query_params.add_new_query("limit", limit);
+        std::string url = endpoint + "/api/v3/klines?" + query_params.to_str();
+        startAsync(url, [callback](CURLcode res_curl, const std::string &buffer) {
+            Klines res;
+            int code = res_curl;
+            std::string str = res_curl == CURLE_OK ? "" : curl_easy_strerror(res_curl);
+            if (res_curl == CURLE_OK)
+                parseKlines(buffer, res, code, str);
+            callback(res, code, str);
+        });
+    }
+
+    void getDepthAsync(std::string symbol, int limit, DepthCallback callback) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        query_params.add_new_query("limit", limit);
+        std::string url = endpoint + "/api/v3/depth?" + query_params.to_str();
+        startAsync(url, makeAsyncHandler(callback));
+    }
+
+    void getBookTickerAsync(std::string symbol, BookTickerCallback callback) {
+        QueryParams query_params;
+        query_params.add_new_query("symbol", symbol);
+        std::string url = endpoint + "/api/v3/ticker/bookTicker?" + query_params.to_str();
+        startAsync(url, makeAsyncHandler(callback));
+    }
+
+    // perform started requests until all of them are done, including those
+    // started by callbacks, or 'timeout_ms' is over (-1: no timeout),
+    // return the number of requests not done yet
+    size_t runAsync(int timeout_ms = -1) {
+        auto start = std::chrono::steady_clock::now();
+        while (!async_requests.empty()) {
+            int64_t queue_wait_us = startQueuedAsync();
+            int running = 0;
+            curl_multi_perform(curl_multi, &running);
+
+            CURLMsg *msg;
+            int queued;
+            while ((msg = curl_multi_info_read(curl_multi, &queued)) != NULL) {
+                if (msg->msg != CURLMSG_DONE)
+                    continue;
+                finishAsync(msg->easy_handle, msg->data.result);
+            }
+
+            if (async_requests.empty())
+                break;
+
+            int wait_ms = 100;
+            if (timeout_ms >= 0) {
+                auto elapsed = duration_cast<milliseconds>(std::chrono::steady_clock::now() - start).count();
+                if (elapsed >= timeout_ms)
+                    break;
+                wait_ms = std::min<int>(wait_ms, timeout_ms - elapsed);
+            }
+            if (queue_wait_us > 0)
+                wait_ms = std::min<int>(wait_ms, queue_wait_us / 1000 + 1);
+            curl_multi_poll(curl_multi, NULL, 0, wait_ms, NULL);
+        }
+        return async_requests.size();
+    }
+
     bool testOrder(std::string symbol = "", std::string side = "BUY", std::string type = "MARKET", double quantity = 0.0,
                    double quoteOrderQty = 0.0, double price = 0.0, std::string newClientOrderId = "", long recvWindow = 0,
                    long timestamp = 0)
@@ -578,15 +810,10 @@ public:
             query_params.add_new_query("newClientOrderId", newClientOrderId);
         if (recvWindow != 0)
             query_params.add_new_query("recvWindow", recvWindow);
-        query_params.add_new_query("timestamp", toString(get_current_ms_epoch()));
-        query_params.add_signature(hmac_sha256(secret_key.c_str(), query_params.to_str().c_str()));
 
         std::string url = endpoint + "/api/v3/order/test?";
 
-        std::vector<Header> headr1 = {{"Content-Type", "application/json"},
-                                      {api_key_header, api_key}};
-
-        auto res_curl = startCurl(url, query_params.to_str(), headr1, Action::POST_ACTION);
+        auto res_curl = startSigned(url, query_params, Action::POST_ACTION);
 
         if (res_curl == CURLE_OK && curl_buffer == "{}")
             return true;
@@ -612,15 +839,10 @@ public:
             query_params.add_new_query("newClientOrderId", newClientOrderId);
         if (recvWindow != 0)
             query_params.add_new_query("recvWindow", recvWindow);
-        query_params.add_new_query("timestamp", toString(get_current_ms_epoch()));
-        query_params.add_signature(hmac_sha256(secret_key.c_str(), query_params.to_str().c_str()));
 
         std::string url = endpoint + "/api/v3/order?";
 
-        std::vector<Header> headr1 = {{"Content-Type", "application/json"},
-                                      {api_key_header, api_key}};
-
-        auto res_curl = startCurl(url, query_params.to_str(), headr1, Action::POST_ACTION);
+        auto res_curl = startSigned(url, query_params, Action::POST_ACTION);
 
         OrderOpen res;
 
@@ -649,15 +871,10 @@ public:
             query_params.add_new_query("newClientOrderId", newClientOrderId);
         if (recvWindow != 0)
             query_params.add_new_query("recvWindow", recvWindow);
-        query_params.add_new_query("timestamp", toString(get_current_ms_epoch()));
-        query_params.add_signature(hmac_sha256(secret_key.c_str(), query_params.to_str().c_str()));
 
         std::string url = endpoint + "/api/v3/order?";
 
-        std::vector<Header> headr1 = {{"Content-Type", "application/json"},
-                                      {api_key_header, api_key}};
-
-        auto res_curl = startCurl(url, query_params.to_str(), headr1, Action::DELETE_ACTION);
+        auto res_curl = startSigned(url, query_params, Action::DELETE_ACTION);
 
         OrderClode res;
 
@@ -677,6 +894,11 @@ public:
         return errorCode;
     }
 
+    // weight limit of all requests, with its queue and wait counters
+    RateLimiter &rateLimiter() {
+        return rate_limiter;
+    }
+
     std::string errorString() {
         return errorStr;
     }
@@ -691,6 +913,504 @@ private:
                 errorStr = msg->get<std::string>();
         }
     }
+
+    static void parceError(const nlohmann::json &result, int &code, std::string &str) {
+        if (!result.is_object())
+            return;
+        auto c = result.find("code");
+        auto msg = result.find("msg");
+        if (c != result.end()) {
+            code = c->get<int>();
+            if (msg != result.end())
+                str = msg->get<std::string>();
+        }
+    }
+
+    // parse a response into 'res' unless it is an error
+    template<typename T> static void parseResult(const std::string &buffer, T &res, int &code, std::string &str) {
+        if (nlohmann::json::accept(buffer)) {
+            nlohmann::json result = nlohmann::json::parse(buffer);
+            parceError(result, code, str);
+            if (code == 0) res = result.get<T>();
+        }
+    }
+
+    // an error response or a body that can not be decoded
+    static void parseError(const std::string &buffer, int &code, std::string &str) {
+        if (nlohmann::json::accept(buffer))
+            parceError(nlohmann::json::parse(buffer), code, str);
+    }
+
+    // GET 'url' and decode the response with 'decode', or its error
+    template<typename F> bool getFixed(const std::string &url, F decode) {
+        auto res_curl = startCurl(url, "", public_headers, Action::GET_ACTION);
+        if (res_curl == CURLE_OK && !decode(curl_buffer)) {
+            parseError(curl_buffer, errorCode, errorStr);
+            if (errorCode == 0) {
+                errorCode = -1;
+                errorStr = "unexpected response";
+            }
+        }
+        return errorCode == 0;
+    }
+
+    static void parseKlines(const std::string &buffer, Klines &res, int &code, std::string &str) {
+        if (decodeKlines(buffer, res))
+            return;
+        res.clear();
+        parseError(buffer, code, str);
+    }
+
+    static void parseResult(const std::string &buffer, Trades &res, int &code, std::string &str) {
+        if (decodeTrades(buffer, res))
+            return;
+        res.clear();
+        parseError(buffer, code, str);
+    }
+
+    static void parseResult(const std::string &buffer, AggTrades &res, int &code, std::string &str) {
+        if (decodeAggTrades(buffer, res))
+            return;
+        res.clear();
+        parseError(buffer, code, str);
+    }
+
+    static void parseResult(const std::string &buffer, DepthPrice &res, int &code, std::string &str) {
+        if (decodeDepth(buffer, res))
+            return;
+        res.bids.clear();
+        res.asks.clear();
+        parseError(buffer, code, str);
+    }
+
+    // {"key": value, ...}, 'field' reads or skips the value of a key
+    template<typename F> static bool decodeObject(JsonCursor &cur, F field) {
+        if (!cur.consume('{'))
+            return false;
+        if (cur.consume('}'))
+            return true;
+        do {
+            const char *k;
+            size_t n;
+            if (!cur.key(k, n) || !field(k, n))
+                return false;
+        } while (cur.consume(','));
+        return cur.consume('}');
+    }
+
+    // [item, ...] into 'res', reusing its elements
+    template<typename T, typename F> static bool decodeArray(JsonCursor &cur, std::vector<T> &res, F item) {
+        size_t size = 0;
+        if (!cur.consume('['))
+            return false;
+        if (!cur.consume(']')) {
+            do {
+                if (size == res.size())
+                    res.emplace_back();
+                if (!item(res[size++]))
+                    return false;
+            } while (cur.consume(','));
+            if (!cur.consume(']'))
+                return false;
+        }
+        res.resize(size);
+        return true;
+    }
+
+    static bool decodeString(JsonCursor &cur, std::string &res) {
+        const char *s;
+        size_t n;
+        if (!cur.string(s, n))
+            return false;
+        res.assign(s, n);
+        return true;
+    }
+
+    // ids are null, numbers or numbers in strings, null is 0
+    static bool decodeId(JsonCursor &cur, int64_t &res) {
+        res = 0;
+        return cur.null() || cur.integer(res);
+    }
+
+public:
+    // Decode responses in place into 'res', reusing its storage, so nothing
+    // is allocated per row once 'res' has grown. Return false if 'buffer'
+    // is not such a response, e.g. an error.
+    static bool decodeKlines(const std::string &buffer, Klines &res) {
+        JsonCursor cur(buffer);
+        return decodeArray(cur, res, [&](Kline &item) {
+            // every field is positional, so a short row fails
+            if (!cur.consume('[')
+                    || !cur.integer(item.open_time) || !cur.consume(',')
+                    || !cur.decimal(item.open) || !cur.consume(',')
+                    || !cur.decimal(item.high) || !cur.consume(',')
+                    || !cur.decimal(item.low) || !cur.consume(',')
+                    || !cur.decimal(item.close) || !cur.consume(',')
+                    || !cur.decimal(item.volume) || !cur.consume(',')
+                    || !cur.integer(item.close_time) || !cur.consume(',')
+                    || !cur.decimal(item.quote_asset_volume))
+                return false;
+            while (cur.consume(',')) {
+                if (!cur.skipValue())
+                    return false;
+            }
+            return cur.consume(']');
+        }) && cur.atEnd();
+    }
+
+    static bool decodeTrades(const std::string &buffer, Trades &res) {
+        JsonCursor cur(buffer);
+        return decodeArray(cur, res, [&](Trade &item) {
+            // a reused element keeps nothing of the last response, the
+            // strings keep their storage
+            item.id = 0;
+            item.price.clear();
+            item.qty.clear();
+            item.quoteQty.clear();
+            item.time = 0;
+            item.isBuyerMaker = false;
+            item.isBestMatch = false;
+            item.tradeType.clear();
+            return decodeObject(cur, [&](const char *k, size_t n) {
+                if (keyIs(k, n, "id")) return decodeId(cur, item.id);
+                if (keyIs(k, n, "price")) return decodeString(cur, item.price);
+                if (keyIs(k, n, "qty")) return decodeString(cur, item.qty);
+                if (keyIs(k, n, "quoteQty")) return decodeString(cur, item.quoteQty);
+                if (keyIs(k, n, "time")) return cur.integer(item.time);
+                if (keyIs(k, n, "isBuyerMaker")) return cur.boolean(item.isBuyerMaker);
+                if (keyIs(k, n, "isBestMatch")) return cur.boolean(item.isBestMatch);
+                if (keyIs(k, n, "tradeType")) return decodeString(cur, item.tradeType);
+                return cur.skipValue();
+            });
+        }) && cur.atEnd();
+    }
+
+    static bool decodeAggTrades(const std::string &buffer, AggTrades &res) {
+        JsonCursor cur(buffer);
+        return decodeArray(cur, res, [&](AggTrade &item) {
+            item.a = 0;
+            item.f = 0;
+            item.l = 0;
+            item.p.clear();
+            item.q.clear();
+            item.T = 0;
+            item.m = false;
+            item.M = false;
+            return decodeObject(cur, [&](const char *k, size_t n) {
+                if (keyIs(k, n, "a")) return decodeId(cur, item.a);
+                if (keyIs(k, n, "f")) return decodeId(cur, item.f);
+                if (keyIs(k, n, "l")) return decodeId(cur, item.l);
+                if (keyIs(k, n, "p")) return decodeString(cur, item.p);
+                if (keyIs(k, n, "q")) return decodeString(cur, item.q);
+                if (keyIs(k, n, "T")) return cur.integer(item.T);
+                if (keyIs(k, n, "m")) return cur.boolean(item.m);
+                if (keyIs(k, n, "M")) return cur.boolean(item.M);
+                return cur.skipValue();
+            });
+        }) && cur.atEnd();
+    }
+
+    static bool decodeDepth(const std::string &buffer, DepthPrice &res) {
+        JsonCursor cur(buffer);
+        auto levels = [&](std::vector<std::vector<std::string>> &side) {
+            return decodeArray(cur, side, [&](std::vector<std::string> &level) {
+                return decodeArray(cur, level, [&](std::string &value) {
+                    return decodeString(cur, value);
+                });
+            });
+        };
+        bool has_id = false;
+        return decodeObject(cur, [&](const char *k, size_t n) {
+            if (keyIs(k, n, "lastUpdateId")) {
+                int64_t id;
+                if (!cur.integer(id))
+                    return false;
+                res.lastUpdateId = id;
+                has_id = true;
+                return true;
+            }
+            if (keyIs(k, n, "bids")) return levels(res.bids);
+            if (keyIs(k, n, "asks")) return levels(res.asks);
+            return cur.skipValue();
+        }) && has_id && cur.atEnd();
+    }
+
+    static bool decodeDepth(const std::string &buffer, const FixedScale &scale, FixedDepth &res) {
+        return decodeDepth(buffer.data(), buffer.data() + buffer.size(), scale, res);
+    }
+
+    static bool decodeDepth(const char *begin, const char *end, const FixedScale &scale, FixedDepth &res) {
+        JsonCursor cur(begin, end);
+        auto levels = [&](std::vector<FixedLevel> &side) {
+            return decodeArray(cur, side, [&](FixedLevel &level) {
+                if (!cur.consume('[')
+                        || !cur.fixed(level.price, scale.price) || !cur.consume(',')
+                        || !cur.fixed(level.qty, scale.qty))
+                    return false;
+                while (cur.consume(',')) {
+                    if (!cur.skipValue())
+                        return false;
+                }
+                return cur.consume(']');
+            });
+        };
+        bool has_id = false;
+        return decodeObject(cur, [&](const char *k, size_t n) {
+            if (keyIs(k, n, "lastUpdateId")) return has_id = cur.integer(res.lastUpdateId);
+            if (keyIs(k, n, "bids")) return levels(res.bids);
+            if (keyIs(k, n, "asks")) return levels(res.asks);
+            return cur.skipValue();
+        }) && has_id && cur.atEnd();
+    }
+
+    // the "d" object of an increase.depth stream message, the changed levels
+    // of version "r", which goes to lastUpdateId
+    static bool decodeDepthUpdate(const char *begin, const char *end, const FixedScale &scale, FixedDepth &res) {
+        JsonCursor cur(begin, end);
+        auto levels = [&](std::vector<FixedLevel> &side) {
+            return decodeArray(cur, side, [&](FixedLevel &level) {
+                bool has_price = false;
+                bool has_qty = false;
+                return decodeObject(cur, [&](const char *k, size_t n) {
+                    if (keyIs(k, n, "p")) return has_price = cur.fixed(level.price, scale.price);
+                    if (keyIs(k, n, "v")) return has_qty = cur.fixed(level.qty, scale.qty);
+                    return cur.skipValue();
+                }) && has_price && has_qty;
+            });
+        };
+        // a side may be missing
+        res.bids.clear();
+        res.asks.clear();
+        bool has_version = false;
+        return decodeObject(cur, [&](const char *k, size_t n) {
+            if (keyIs(k, n, "r")) return has_version = cur.integer(res.lastUpdateId);
+            if (keyIs(k, n, "bids")) return levels(res.bids);
+            if (keyIs(k, n, "asks")) return levels(res.asks);
+            return cur.skipValue();
+        }) && has_version && cur.atEnd();
+    }
+
+    static bool decodeTrades(const std::string &buffer, const FixedScale &scale, FixedTrades &res) {
+        JsonCursor cur(buffer);
+        return decodeArray(cur, res, [&](FixedTrade &item) {
+            item.id = 0;
+            return decodeObject(cur, [&](const char *k, size_t n) {
+                if (keyIs(k, n, "id")) return cur.null() || cur.integer(item.id);
+                if (keyIs(k, n, "price")) return cur.fixed(item.price, scale.price);
+                if (keyIs(k, n, "qty")) return cur.fixed(item.qty, scale.qty);
+                if (keyIs(k, n, "quoteQty")) return cur.fixed(item.quoteQty, scale.quote);
+                if (keyIs(k, n, "time")) return cur.integer(item.time);
+                if (keyIs(k, n, "isBuyerMaker")) return cur.boolean(item.isBuyerMaker);
+                if (keyIs(k, n, "isBestMatch")) return cur.boolean(item.isBestMatch);
+                if (keyIs(k, n, "tradeType")) {
+                    const char *s;
+                    size_t len;
+                    if (!cur.string(s, len))
+                        return false;
+                    item.isBid = keyIs(s, len, "BID");
+                    return true;
+                }
+                return cur.skipValue();
+            });
+        }) && cur.atEnd();
+    }
+
+    static bool decodeAvgPrice(const std::string &buffer, const FixedScale &scale, FixedAvgPrice &res) {
+        JsonCursor cur(buffer);
+        bool has_price = false;
+        return decodeObject(cur, [&](const char *k, size_t n) {
+            if (keyIs(k, n, "mins")) {
+                int64_t mins;
+                if (!cur.integer(mins))
+                    return false;
+                res.mins = (int)mins;
+                return true;
+            }
+            if (keyIs(k, n, "price")) return has_price = cur.fixed(res.price, scale.price);
+            return cur.skipValue();
+        }) && has_price && cur.atEnd();
+    }
+
+    static bool decode24hr(const std::string &buffer, const FixedScale &scale, Fixed24hr &res) {
+        JsonCursor cur(buffer);
+        bool has_price = false;
+        return decodeObject(cur, [&](const char *k, size_t n) {
+            if (keyIs(k, n, "priceChange")) return cur.fixed(res.priceChange, scale.price);
+            if (keyIs(k, n, "priceChangePercent")) return cur.decimal(res.priceChangePercent);
+            if (keyIs(k, n, "prevClosePrice")) return cur.fixed(res.prevClosePrice, scale.price);
+            if (keyIs(k, n, "lastPrice")) return has_price = cur.fixed(res.lastPrice, scale.price);
+            if (keyIs(k, n, "bidPrice")) return cur.fixed(res.bidPrice, scale.price);
+            if (keyIs(k, n, "bidQty")) return cur.fixed(res.bidQty, scale.qty);
+            if (keyIs(k, n, "askPrice")) return cur.fixed(res.askPrice, scale.price);
+            if (keyIs(k, n, "askQty")) return cur.fixed(res.askQty, scale.qty);
+            if (keyIs(k, n, "openPrice")) return cur.fixed(res.openPrice, scale.price);
+            if (keyIs(k, n, "highPrice")) return cur.fixed(res.highPrice, scale.price);
+            if (keyIs(k, n, "lowPrice")) return cur.fixed(res.lowPrice, scale.price);
+            if (keyIs(k, n, "volume")) return cur.fixed(res.volume, scale.qty);
+            if (keyIs(k, n, "quoteVolume")) return cur.null() || cur.fixed(res.quoteVolume, scale.quote);
+            if (keyIs(k, n, "openTime")) return cur.integer(res.openTime);
+            if (keyIs(k, n, "closeTime")) return cur.integer(res.closeTime);
+            if (keyIs(k, n, "count")) return cur.null() || cur.integer(res.count);
+            return cur.skipValue();
+        }) && has_price && cur.atEnd();
+    }
+
+    static bool decodePrice(const std::string &buffer, const FixedScale &scale, FixedPrice &res) {
+        JsonCursor cur(buffer);
+        bool has_price = false;
+        return decodeObject(cur, [&](const char *k, size_t n) {
+            if (keyIs(k, n, "price")) return has_price = cur.fixed(res.price, scale.price);
+            return cur.skipValue();
+        }) && has_price && cur.atEnd();
+    }
+
+    static bool decodeBookTicker(const std::string &buffer, const FixedScale &scale, FixedBookTicker &res) {
+        JsonCursor cur(buffer);
+        bool has_price = false;
+        return decodeObject(cur, [&](const char *k, size_t n) {
+            if (keyIs(k, n, "bidPrice")) return has_price = cur.fixed(res.bidPrice, scale.price);
+            if (keyIs(k, n, "bidQty")) return cur.fixed(res.bidQty, scale.qty);
+            if (keyIs(k, n, "askPrice")) return cur.fixed(res.askPrice, scale.price);
+            if (keyIs(k, n, "askQty")) return cur.fixed(res.askQty, scale.qty);
+            return cur.skipValue();
+        }) && has_price && cur.atEnd();
+    }
+
+private:
+
+    // a request performed by curl_multi
+    struct AsyncRequest {
+        CURL *curl;
+        std::string url;
+        std::string buffer;
+        std::function<void(CURLcode, const std::string &)> done;
+        int weight;
+        int retries;
+        // when it was queued for tokens, in microseconds
+        int64_t queued_at;
+    };
+
+    // times a request answered by 429 is retried
+    static const int MAX_RETRIES = 3;
+
+    // request weights of the endpoints, 1 for the others
+    static int requestWeight(const std::string &url) {
+        static const struct {
+            const char *path;
+            int weight;
+        } weights[] = {
+            {"/api/v3/exchangeInfo", 10},
+            {"/api/v3/trades", 5},
+        };
+        for (auto &w : weights) {
+            if (url.find(w.path) != std::string::npos)
+                return w.weight;
+        }
+        return 1;
+    }
+
+    // seconds to wait from the Retry-After header, 1 if there is none
+    static int64_t retryAfterMs(CURL *curl) {
+        curl_off_t retry_after = 0;
+        curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+        return retry_after > 0 ? retry_after * 1000 : 1000;
+    }
+
+    static bool isThrottled(CURL *curl) {
+        long code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        return code == 429;
+    }
+
+    template<typename T>
+    static std::function<void(CURLcode, const std::string &)> makeAsyncHandler(
+        std::function<void(T &, int, const std::string &)> callback) {
+        return [callback](CURLcode res_curl, const std::string &buffer) {
+            T res{};
+            int code = res_curl;
+            std::string str = res_curl == CURLE_OK ? "" : curl_easy_strerror(res_curl);
+            if (res_curl == CURLE_OK)
+                parseResult(buffer, res, code, str);
+            callback(res, code, str);
+        };
+    }
+
+    void startAsync(const std::string &url, std::function<void(CURLcode, const std::string &)> done) {
+        std::unique_ptr<AsyncRequest> request(new AsyncRequest);
+        if (!idle_async_curls.empty()) {
+            request->curl = idle_async_curls.back();
+            idle_async_curls.pop_back();
+        }
+        else {
+            request->curl = curl_easy_init();
+            setCommonOptions(request->curl, curl_share, NULL);
+        }
+        request->url = url;
+        request->done = done;
+        request->weight = requestWeight(url);
+        request->retries = 0;
+
+        curl_easy_setopt(request->curl, CURLOPT_URL, request->url.c_str());
+        curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, public_headers);
+        curl_easy_setopt(request->curl, CURLOPT_WRITEDATA, (void *)&request->buffer);
+        curl_easy_setopt(request->curl, CURLOPT_PRIVATE, (void *)request.get());
+        queueAsync(request.get());
+        async_requests.push_back(std::move(request));
+    }
+
+    // add the request to curl_multi, or queue it until there are tokens
+    void queueAsync(AsyncRequest *request) {
+        if (queued_async.empty()
+                && rate_limiter.tryAcquire(request->weight, RateLimiter::Priority::MARKET_DATA)) {
+            curl_multi_add_handle(curl_multi, request->curl);
+            return;
+        }
+        request->queued_at = RateLimiter::now();
+        rate_limiter.enqueue();
+        queued_async.push_back(request);
+    }
+
+    // start the queued requests there are tokens for, in order,
+    // return the microseconds until the next one can start
+    int64_t startQueuedAsync() {
+        while (!queued_async.empty()) {
+            AsyncRequest *request = queued_async.front();
+            if (!rate_limiter.tryAcquire(request->weight, RateLimiter::Priority::MARKET_DATA))
+                return rate_limiter.delay(request->weight, RateLimiter::Priority::MARKET_DATA);
+            queued_async.pop_front();
+            rate_limiter.dequeue(RateLimiter::now() - request->queued_at);
+            curl_multi_add_handle(curl_multi, request->curl);
+        }
+        return 0;
+    }
+
+    void finishAsync(CURL *curl, CURLcode res_curl) {
+        AsyncRequest *request = NULL;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&request);
+        curl_multi_remove_handle(curl_multi, curl);
+
+        if (res_curl == CURLE_OK && isThrottled(curl) && request->retries < MAX_RETRIES) {
+            rate_limiter.pause(retryAfterMs(curl), RateLimiter::Priority::MARKET_DATA);
+            request->retries++;
+            request->buffer.clear();
+            queueAsync(request);
+            return;
+        }
+
+        std::unique_ptr<AsyncRequest> done;
+        for (size_t i=0, s=async_requests.size(); i<s; i++) {
+            if (async_requests[i].get() == request) {
+                done = std::move(async_requests[i]);
+                async_requests.erase(async_requests.begin() + i);
+                break;
+            }
+        }
+
+        // the handle keeps its connection for the next request
+        idle_async_curls.push_back(curl);
+        if (done)
+            done->done(res_curl, done->buffer);
+    }
     static size_t curl_callback(char *data, size_t size, size_t nmemb, std::string *buffer) {
         size_t result = 0;
 
@@ -701,69 +1421,171 @@ private:
         return result;
     }
 
-    CURLcode startCurl(std::string url, std::string data, std::vector<Header> headers, Action action) {
-        errorCode = 0;
-        errorStr = "";
-
-        curl_buffer.clear();
-
-        CURL *curl;
-        curl = curl_easy_init();
-
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    static void setCommonOptions(CURL *curl, CURLSH *share, std::string *buffer) {
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&curl_buffer);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)buffer);
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+        curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 3600L);
+    }
+
+    void initCurl() {
+        // DNS, TLS sessions and connections are shared by both handles
+        curl_share = curl_share_init();
+        curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+        // market data and orders have their own handle and connection,
+        // so an order never waits for a market data connection to be reopened
+        curl_public = curl_easy_init();
+        curl_private = curl_easy_init();
+        setCommonOptions(curl_public, curl_share, &curl_buffer);
+        setCommonOptions(curl_private, curl_share, &curl_buffer);
+
+        public_headers = NULL;
+        private_headers = NULL;
+        buildHeaders();
+
+        curl_multi = curl_multi_init();
+        curl_multi_setopt(curl_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(curl_multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, 64L);
+    }
 
+    void cleanupCurl() {
+        for (auto &request : async_requests) {
+            curl_multi_remove_handle(curl_multi, request->curl);
+            curl_easy_cleanup(request->curl);
+        }
+        for (auto curl : idle_async_curls)
+            curl_easy_cleanup(curl);
+        curl_multi_cleanup(curl_multi);
+        curl_easy_cleanup(curl_public);
+        curl_easy_cleanup(curl_private);
+        curl_share_cleanup(curl_share);
+        curl_slist_free_all(public_headers);
+        curl_slist_free_all(private_headers);
+    }
+
+    static struct curl_slist *makeHeaders(const std::vector<Header> &headers) {
         struct curl_slist *list = NULL;
         for (auto &h : headers) {
             std::string val{h.key + ": " + h.value};
             list = curl_slist_append(list, val.c_str());
         }
+        return list;
+    }
 
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+    void buildHeaders() {
+        curl_slist_free_all(public_headers);
+        curl_slist_free_all(private_headers);
+        public_headers = makeHeaders(headr);
+        private_headers = makeHeaders({{"Content-Type", "application/json"},
+                                       {api_key_header, api_key}});
+    }
+
+    CURLcode startCurl(const std::string &url, const std::string &data, struct curl_slist *headers, Action action) {
+        return startCurl(curl_public, url, data, headers, action);
+    }
+
+    CURLcode startCurl(CURL *curl, const std::string &url, const std::string &data, struct curl_slist *headers, Action action) {
+        return startCurl(curl, url, [&data]() -> const std::string & { return data; }, headers, action);
+    }
+
+    // signed with a new timestamp at every attempt, after waiting for tokens,
+    // so an order retried after a 429 is not stale; the query is written
+    // once, each attempt only replaces its timestamp and signature
+    CURLcode startSigned(const std::string &url, const QueryParams &query_params, Action action) {
+        query_params.to_str(query_buffer);
+        if (!query_buffer.empty())
+            query_buffer += '&';
+        query_buffer += "timestamp=";
+        size_t fixed = query_buffer.size();
+        return startCurl(curl_private, url, [this, fixed]() -> const std::string & {
+            query_buffer.resize(fixed);
+            query_buffer += std::to_string(get_current_ms_epoch());
+            return sign();
+        }, private_headers, action);
+    }
+
+    // 'data' is called before every attempt
+    CURLcode startCurl(CURL *curl, const std::string &url, const std::function<const std::string &()> &data,
+                       struct curl_slist *headers, Action action) {
+        errorCode = 0;
+        errorStr = "";
+
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        // the handle is reused, so reset the method left by the previous request
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, NULL);
         if (action == Action::POST_ACTION) {
             curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, get_Action(action).c_str());
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
         }
         else if (action == Action::PUT_ACTION || action == Action::DELETE_ACTION) {
             curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, get_Action(action).c_str());
         }
 
+        // signed requests are orders, they may use the tokens market data may not
+        auto priority = curl == curl_private ? RateLimiter::Priority::ORDER : RateLimiter::Priority::MARKET_DATA;
+        int weight = requestWeight(url);
+
         CURLcode res;
-        res = curl_easy_perform(curl);
+        for (int retries = 0; ; retries++) {
+            rate_limiter.acquire(weight, priority);
+            const std::string &fields = data();
+            if (action == Action::POST_ACTION)
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, fields.c_str());
+            curl_buffer.clear();
+            res = curl_easy_perform(curl);
+            if (res != CURLE_OK || !isThrottled(curl) || retries == MAX_RETRIES)
+                break;
+            rate_limiter.pause(retryAfterMs(curl), priority);
+        }
 
         if (res != CURLE_OK) {
             errorCode = res;
             errorStr = curl_easy_strerror(res);
         }
 
-        curl_easy_cleanup(curl);
-
         return res;
     }
 
-    std::string b2a_hex(char *byte_arr, int n)
+    static void b2a_hex(const unsigned char *byte_arr, int n, char *out)
     {
-        const static std::string HexCodes = "0123456789abcdef";
-        std::string HexString;
-        for ( int i = 0; i < n ; ++i ) {
-            unsigned char BinValue = byte_arr[i];
-            HexString += HexCodes[( BinValue >> 4 ) & 0x0F];
-            HexString += HexCodes[BinValue & 0x0F];
+        static const char HexCodes[] = "0123456789abcdef";
+        for (int i = 0; i < n; ++i) {
+            out[2 * i] = HexCodes[byte_arr[i] >> 4];
+            out[2 * i + 1] = HexCodes[byte_arr[i] & 0x0F];
         }
+    }
 
-        return HexString;
+    // HMAC-SHA256 keyed with secret_key; the key pads are computed here
+    // once, each signature only resets the context
+    void initHmac() {
+        mbedtls_md_free(&hmac_ctx);
+        mbedtls_md_init(&hmac_ctx);
+        mbedtls_md_setup(&hmac_ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+        mbedtls_md_hmac_starts(&hmac_ctx, reinterpret_cast<const unsigned char *>(secret_key.data()),
+                               secret_key.size());
     }
 
-    std::string hmac_sha256(const char *key, const char *data)
-    {
+    // append the signature of the query string in 'query_buffer' to it
+    const std::string &sign() {
         unsigned char digest[32];
-        mbedtls_md_hmac( mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
-                        reinterpret_cast<const unsigned char*>(key), strlen(key),
-                        reinterpret_cast<const unsigned char*>(data), strlen(data),
-                        digest );
-        return b2a_hex((char *)digest, 32);
+        mbedtls_md_hmac_reset(&hmac_ctx);
+        mbedtls_md_hmac_update(&hmac_ctx, reinterpret_cast<const unsigned char *>(query_buffer.data()),
+                               query_buffer.size());
+        mbedtls_md_hmac_finish(&hmac_ctx, digest);
+
+        query_buffer += "&signature=";
+        size_t size = query_buffer.size();
+        query_buffer.resize(size + 2 * sizeof(digest));
+        b2a_hex(digest, sizeof(digest), &query_buffer[size]);
+        return query_buffer;
     }
 
     std::uint64_t get_current_ms_epoch()
@@ -786,7 +1608,23 @@ private:
     const std::string api_key_header;
     const std::string endpoint;
     std::string curl_buffer;
+    mbedtls_md_context_t hmac_ctx;
+    // query string of the last signed request, posted from here
+    std::string query_buffer;
     std::vector<Header> headr = {{"Content-Type", "application/json"}};
+    CURLSH *curl_share;
+    // market data requests
+    CURL *curl_public;
+    // signed requests
+    CURL *curl_private;
+    struct curl_slist *public_headers;
+    struct curl_slist *private_headers;
+    CURLM *curl_multi;
+    std::vector<std::unique_ptr<AsyncRequest>> async_requests;
+    std::vector<CURL *> idle_async_curls;
+    // async requests waiting for tokens
+    std::deque<AsyncRequest *> queued_async;
+    RateLimiter rate_limiter;
     int errorCode;
     std::string errorStr;
 };
@@ -0,0 +1,162 @@
+#ifndef MEXC_BACKTEST_HPP
+#define MEXC_BACKTEST_HPP
+
+#include <stdlib.h>
+#include "../gbdt/gbdt.h"
+#include "../gbdt/thread-pool.h"
+#include "mexc.hpp"
+#include "mexc_features.hpp"
+#include "mexc_history.hpp"
+
+struct BacktestReport {
+    // bars with a complete x
+    size_t bars;
+    // BUY and SELL signals
+    size_t signals;
+    // filled orders
+    size_t trades;
+    // SELLs with nothing to sell, rejected by the exchange on spot
+    size_t rejected;
+    // SELLs closing a part of the position, and those above its cost
+    size_t closing;
+    size_t wins;
+    // in the quote asset
+    double fees;
+    // equity at the last close, fees included
+    double pnl;
+    // largest fall of the equity from its highest value
+    double max_drawdown;
+
+    double hitRate() const {
+        return closing ? (double)wins / closing : 0;
+    }
+};
+
+// Backtest of the signals of a model over stored bars, with the trading
+// rules of the live loop: BUY 'quantity' over 'threshold', SELL it under
+// -'threshold', as market orders filled at the open of the next bar and
+// charged the taker fee. Cancelling the previous order before each one
+// changes nothing here, market orders are filled at once.
+//
+// Bars go through in chunks: x of a chunk is computed by the same Features
+// as live, scored with predict_batch (spread over 'threads'), then the
+// orders of the chunk are simulated; nothing is allocated per bar.
+class Backtest
+{
+public:
+    // 'fee' is a fraction of the notional, see takerFee
+    Backtest(const GBDTPredictor &model, int input, int inputSma, double fee, double quantity = 1.0,
+             double threshold = 0.5, size_t threads = 1)
+        : model{model}, input{input}, inputSma{inputSma}, fee{fee}, quantity{quantity}, threshold{threshold},
+          pool{threads} {
+    }
+
+    Backtest(const Backtest &) = delete;
+    Backtest &operator=(const Backtest &) = delete;
+
+    // fee of market orders of the symbol, 0 if it has none
+    static double takerFee(const Symbol &symbol) {
+        return atof(symbol.takerCommission.c_str());
+    }
+
+    BacktestReport run(const KlineStore &store) {
+        return run(store.opens(), store.closes(), store.size());
+    }
+
+    BacktestReport run(const double *opens, const double *closes, size_t size) {
+        BacktestReport report;
+        memset(&report, 0, sizeof(report));
+
+        Features features(input, inputSma);
+        size_t columns = features.size();
+        rows.resize(CHUNK * columns);
+        scores.resize(CHUNK);
+        indices.resize(CHUNK);
+
+        // long only, as on spot
+        double cash = 0;
+        double position = 0;
+        // of the position, buying fees included
+        double cost = 0;
+        double high = 0;
+
+        size_t i = 0;
+        while (i < size) {
+            size_t n = 0;
+            for (; i < size && n < CHUNK; i++) {
+                if (!features.update(closes[i]))
+                    continue;
+                features.get(&rows[n * columns]);
+                indices[n++] = i;
+            }
+            if (n == 0)
+                break;
+
+            pool.parallel_for_range(n, [&](size_t begin, size_t end) {
+                model.predict_batch(&rows[begin * columns], end - begin, columns, &scores[begin]);
+            });
+            report.bars += n;
+
+            for (size_t k = 0; k < n; k++) {
+                size_t bar = indices[k];
+                double score = scores[k];
+                if (score > threshold || score < -threshold)
+                    report.signals++;
+                // there is no next bar to fill at
+                if (bar + 1 < size) {
+                    double price = opens[bar + 1];
+                    double notional = price * quantity;
+                    if (score > threshold) {
+                        cash -= notional * (1 + fee);
+                        cost += notional * (1 + fee);
+                        position += quantity;
+                        report.fees += notional * fee;
+                        report.trades++;
+                    }
+                    else if (score < -threshold) {
+                        if (position < quantity) {
+                            report.rejected++;
+                        }
+                        else {
+                            double basis = cost * quantity / position;
+                            cash += notional * (1 - fee);
+                            cost -= basis;
+                            position -= quantity;
+                            report.fees += notional * fee;
+                            report.trades++;
+                            report.closing++;
+                            report.wins += notional * (1 - fee) > basis;
+                        }
+                    }
+                }
+
+                // marked at the close of the filling bar
+                double equity = cash + position * closes[std::min(bar + 1, size - 1)];
+                high = std::max(high, equity);
+                report.max_drawdown = std::max(report.max_drawdown, high - equity);
+            }
+        }
+
+        report.pnl = cash + (size ? position * closes[size - 1] : 0);
+        return report;
+    }
+
+private:
+    // rows scored at once, 4096 rows of 11 values stay in L2
+    static const size_t CHUNK = 4096;
+
+    const GBDTPredictor &model;
+    const int input;
+    const int inputSma;
+    const double fee;
+    const double quantity;
+    const double threshold;
+    ThreadPool pool;
+    // of a chunk
+    std::vector<double> rows;
+    std::vector<double> scores;
+    // bar of each row
+    std::vector<size_t> indices;
+};
+
+#endif // MEXC_BACKTEST_HPP
@@ -0,0 +1,222 @@
+#ifndef MEXC_DECODE_HPP
+#define MEXC_DECODE_HPP
+
+#include <charconv>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+// Pull parser over a response body for the fixed shapes of market data
+// responses. It reads values in place, without building a DOM or copying
+// the body. String values are returned as raw views, escapes are not
+// decoded, which is enough for symbols and decimals.
+class JsonCursor
+{
+public:
+    JsonCursor(const char *begin, const char *end) : p{begin}, end{end} {
+    }
+
+    explicit JsonCursor(const std::string &body) : p{body.data()}, end{body.data() + body.size()} {
+    }
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    // skip spaces and then 'c' if it is next
+    bool consume(char c) {
+        skipSpace();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    bool peek(char c) {
+        skipSpace();
+        return p < end && *p == c;
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return p == end;
+    }
+
+    bool string(const char *&s, size_t &n) {
+        if (!consume('"'))
+            return false;
+        s = p;
+        while (p < end && *p != '"') {
+            if (*p == '\\')
+                p++;
+            p++;
+        }
+        if (p >= end)
+            return false;
+        n = p - s;
+        p++;
+        return true;
+    }
+
+    // "key":
+    bool key(const char *&s, size_t &n) {
+        return string(s, n) && consume(':');
+    }
+
+    bool integer(int64_t &v) {
+        skipSpace();
+        bool quoted = p < end && *p == '"';
+        if (quoted)
+            p++;
+        auto r = std::from_chars(p, end, v);
+        if (r.ec != std::errc())
+            return false;
+        p = r.ptr;
+        return !quoted || consume('"');
+    }
+
+    // a number, quoted or not
+    bool decimal(double &v) {
+        skipSpace();
+        bool quoted = p < end && *p == '"';
+        if (quoted)
+            p++;
+        auto r = std::from_chars(p, end, v);
+        if (r.ec != std::errc())
+            return false;
+        p = r.ptr;
+        return !quoted || consume('"');
+    }
+
+    // a decimal, quoted or not, as an integer scaled by 10^scale,
+    // rounded half away from zero; false if it does not fit in int64_t
+    bool fixed(int64_t &v, int scale) {
+        skipSpace();
+        bool quoted = p < end && *p == '"';
+        if (quoted)
+            p++;
+        bool negative = p < end && *p == '-';
+        if (negative)
+            p++;
+
+        const char *start = p;
+        int64_t value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (!append(value, *p++ - '0'))
+                return false;
+        }
+        int digits = 0;
+        bool round_up = false;
+        if (p < end && *p == '.') {
+            p++;
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (digits < scale) {
+                    if (!append(value, *p - '0'))
+                        return false;
+                    digits++;
+                }
+                else if (digits == scale) {
+                    round_up = *p >= '5';
+                    digits++;
+                }
+                p++;
+            }
+        }
+        if (p == start || (p < end && (*p == 'e' || *p == 'E')))
+            return false;
+        for (; digits < scale; digits++) {
+            if (!append(value, 0))
+                return false;
+        }
+        if (round_up) {
+            if (value == INT64_MAX)
+                return false;
+            value++;
+        }
+        v = negative ? -value : value;
+        return !quoted || consume('"');
+    }
+
+    bool boolean(bool &v) {
+        skipSpace();
+        if (end - p >= 4 && memcmp(p, "true", 4) == 0) {
+            p += 4;
+            v = true;
+            return true;
+        }
+        if (end - p >= 5 && memcmp(p, "false", 5) == 0) {
+            p += 5;
+            v = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool null() {
+        skipSpace();
+        if (end - p >= 4 && memcmp(p, "null", 4) == 0) {
+            p += 4;
+            return true;
+        }
+        return false;
+    }
+
+    // skip any value
+    bool skipValue() {
+        skipSpace();
+        if (p >= end)
+            return false;
+        if (*p == '"') {
+            const char *s;
+            size_t n;
+            return string(s, n);
+        }
+        if (*p == '{' || *p == '[') {
+            char close = *p == '{' ? '}' : ']';
+            p++;
+            if (consume(close))
+                return true;
+            do {
+                if (close == '}') {
+                    const char *s;
+                    size_t n;
+                    if (!key(s, n))
+                        return false;
+                }
+                if (!skipValue())
+                    return false;
+            } while (consume(','));
+            return consume(close);
+        }
+        // number or literal
+        const char *start = p;
+        while (p < end && *p != ',' && *p != ']' && *p != '}' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+            p++;
+        return p != start;
+    }
+
+    const char *position() const {
+        return p;
+    }
+
+private:
+    // value * 10 + digit, false if it overflows
+    static bool append(int64_t &value, int digit) {
+        if (value > (INT64_MAX - digit) / 10)
+            return false;
+        value = value * 10 + digit;
+        return true;
+    }
+
+private:
+    const char *p;
+    const char *end;
+};
+
+inline bool keyIs(const char *s, size_t n, const char *name) {
+    return strlen(name) == n && memcmp(s, name, n) == 0;
+}
+
+#endif // MEXC_DECODE_HPP
@@ -0,0 +1,39 @@
+#ifndef MEXC_FEATURES_HPP
+#define MEXC_FEATURES_HPP
+
+#include "mexc_indicators.hpp"
+
+// x of a bar: its close and the last 'input' SMA values, updated bar by bar
+// by training and live alike, so both see the same values
+class Features
+{
+public:
+    Features(int input, int inputSma) : sma(inputSma), smas(input), close(0) {
+    }
+
+    // add the next closed bar, return true when x is complete
+    bool update(double value) {
+        close = value;
+        sma.update(value);
+        if (sma.ready())
+            smas.push(sma.value());
+        return smas.full();
+    }
+
+    size_t size() const {
+        return smas.capacity() + 1;
+    }
+
+    void get(double *x) const {
+        x[0] = close;
+        for (size_t j = 0; j < smas.capacity(); j++)
+            x[j + 1] = smas.back(j);
+    }
+
+private:
+    Sma sma;
+    RingBuffer<double> smas;
+    double close;
+};
+
+#endif // MEXC_FEATURES_HPP
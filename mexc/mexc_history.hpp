@@ -0,0 +1,294 @@
+#ifndef MEXC_HISTORY_HPP
+#define MEXC_HISTORY_HPP
+
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mexc.hpp"
+
+// Append-only columnar store of closed bars of one symbol and interval.
+// It is a directory with one file per Kline field, each a raw array of
+// 8 byte values in open_time order, so every column stays contiguous
+// while appending and is read through mmap without parsing.
+class KlineStore
+{
+public:
+    KlineStore() : count{0} {
+        for (auto &column : columns) {
+            column.fd = -1;
+            column.data = NULL;
+            column.mapped = 0;
+        }
+    }
+
+    ~KlineStore() {
+        close();
+    }
+
+    KlineStore(const KlineStore &) = delete;
+    KlineStore &operator=(const KlineStore &) = delete;
+
+    // open or create the store in 'dir'; columns left longer than the
+    // others by an interrupted append are cut
+    bool open(const std::string &dir) {
+        close();
+        mkdir(dir.c_str(), 0755);
+
+        size_t rows = SIZE_MAX;
+        for (int i = 0; i < COLUMN_NUMBER; i++) {
+            std::string path = dir + "/" + COLUMN_NAMES[i];
+            columns[i].fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+            if (columns[i].fd == -1) {
+                close();
+                return false;
+            }
+            struct stat st;
+            fstat(columns[i].fd, &st);
+            rows = std::min(rows, (size_t)st.st_size / sizeof(int64_t));
+        }
+        for (auto &column : columns) {
+            if (ftruncate(column.fd, rows * sizeof(int64_t)) == -1) {
+                close();
+                return false;
+            }
+        }
+        count = rows;
+        return map();
+    }
+
+    void close() {
+        for (auto &column : columns) {
+            if (column.data)
+                munmap(column.data, column.mapped);
+            if (column.fd != -1)
+                ::close(column.fd);
+            column.fd = -1;
+            column.data = NULL;
+            column.mapped = 0;
+        }
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // -1 if empty
+    int64_t lastOpenTime() const {
+        return count ? openTimes()[count - 1] : -1;
+    }
+
+    // Append the bars after the last stored one, skipping the others and
+    // repeated open times, 'klines' oldest first.
+    // Return the number of bars appended, -1 on a write error.
+    int append(const Klines &klines) {
+        int64_t last = lastOpenTime();
+        std::vector<int64_t> values[COLUMN_NUMBER];
+        for (auto &kline : klines) {
+            if (kline.open_time <= last)
+                continue;
+            last = kline.open_time;
+            values[OPEN_TIME].push_back(kline.open_time);
+            values[OPEN].push_back(bits(kline.open));
+            values[HIGH].push_back(bits(kline.high));
+            values[LOW].push_back(bits(kline.low));
+            values[CLOSE].push_back(bits(kline.close));
+            values[VOLUME].push_back(bits(kline.volume));
+            values[CLOSE_TIME].push_back(kline.close_time);
+            values[QUOTE_ASSET_VOLUME].push_back(bits(kline.quote_asset_volume));
+        }
+        size_t rows = values[OPEN_TIME].size();
+        if (rows == 0)
+            return 0;
+
+        for (int i = 0; i < COLUMN_NUMBER; i++) {
+            size_t size = rows * sizeof(int64_t);
+            if (write(columns[i].fd, values[i].data(), size) != (ssize_t)size) {
+                // cut the columns back to the last complete row
+                for (int j = 0; j <= i; j++) {
+                    if (ftruncate(columns[j].fd, count * sizeof(int64_t)) == -1)
+                        break;
+                }
+                return -1;
+            }
+        }
+        count += rows;
+        return map() ? (int)rows : -1;
+    }
+
+    const int64_t *openTimes() const {
+        return (const int64_t *)columns[OPEN_TIME].data;
+    }
+
+    const double *opens() const {
+        return (const double *)columns[OPEN].data;
+    }
+
+    const double *highs() const {
+        return (const double *)columns[HIGH].data;
+    }
+
+    const double *lows() const {
+        return (const double *)columns[LOW].data;
+    }
+
+    const double *closes() const {
+        return (const double *)columns[CLOSE].data;
+    }
+
+    const double *volumes() const {
+        return (const double *)columns[VOLUME].data;
+    }
+
+    const int64_t *closeTimes() const {
+        return (const int64_t *)columns[CLOSE_TIME].data;
+    }
+
+    const double *quoteAssetVolumes() const {
+        return (const double *)columns[QUOTE_ASSET_VOLUME].data;
+    }
+
+    Kline at(size_t i) const {
+        return {openTimes()[i], opens()[i], highs()[i], lows()[i], closes()[i], volumes()[i],
+                closeTimes()[i], quoteAssetVolumes()[i]};
+    }
+
+private:
+    enum {
+        OPEN_TIME,
+        OPEN,
+        HIGH,
+        LOW,
+        CLOSE,
+        VOLUME,
+        CLOSE_TIME,
+        QUOTE_ASSET_VOLUME,
+        COLUMN_NUMBER
+    };
+
+    static constexpr const char *COLUMN_NAMES[COLUMN_NUMBER] = {
+        "open_time", "open", "high", "low", "close", "volume", "close_time", "quote_asset_volume"
+    };
+
+    struct Column {
+        int fd;
+        void *data;
+        size_t mapped;
+    };
+
+    static int64_t bits(double value) {
+        int64_t res;
+        memcpy(&res, &value, sizeof(res));
+        return res;
+    }
+
+    // map the columns again after they grew
+    bool map() {
+        for (auto &column : columns) {
+            if (column.data)
+                munmap(column.data, column.mapped);
+            column.data = NULL;
+            column.mapped = count * sizeof(int64_t);
+            if (column.mapped == 0)
+                continue;
+            column.data = mmap(NULL, column.mapped, PROT_READ, MAP_SHARED, column.fd, 0);
+            if (column.data == MAP_FAILED) {
+                column.data = NULL;
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    Column columns[COLUMN_NUMBER];
+    size_t count;
+};
+
+// Downloads closed bars into a KlineStore, in windows of the maximum
+// klines page, several windows at a time through MexcApi's async requests.
+class KlineHistory
+{
+public:
+    // bars per request
+    static const int PAGE_SIZE = 1000;
+
+    // milliseconds of an interval, 0 for months, which have no fixed length
+    static int64_t intervalMs(const std::string &interval) {
+        static const struct {
+            const char *interval;
+            int64_t ms;
+        } intervals[] = {
+            {"1m", 60000LL}, {"5m", 300000LL}, {"15m", 900000LL}, {"30m", 1800000LL}, {"60m", 3600000LL},
+            {"4h", 14400000LL}, {"8h", 28800000LL}, {"1d", 86400000LL}, {"1W", 604800000LL}
+        };
+        for (auto &i : intervals) {
+            if (interval == i.interval)
+                return i.ms;
+        }
+        return 0;
+    }
+
+    // Download the bars closed by now from 'start_ms', or from the last
+    // stored bar if the store has one, 'concurrency' pages at a time.
+    // Return the number of bars appended, -1 on error.
+    static int download(MexcApi &api, KlineStore &store, std::string symbol, std::string interval,
+                        int64_t start_ms, int concurrency = 16) {
+        int64_t interval_ms = intervalMs(interval);
+        if (interval_ms == 0) {
+            fprintf(stderr, "unsupported interval %s\n", interval.c_str());
+            return -1;
+        }
+        int64_t now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        if (store.size())
+            start_ms = store.lastOpenTime() + interval_ms;
+        start_ms -= start_ms % interval_ms;
+
+        int appended = 0;
+        int64_t page_ms = PAGE_SIZE * interval_ms;
+        while (start_ms < now) {
+            // results by page, appended in order once all are done
+            std::map<int64_t, Klines> pages;
+            int code = 0;
+            std::string str;
+            for (int i = 0; i < concurrency && start_ms < now; i++, start_ms += page_ms) {
+                int64_t page_start = start_ms;
+                api.getKlinesAsync(symbol, interval, page_start, page_start + page_ms - 1, PAGE_SIZE,
+                                   [&pages, &code, &str, page_start](Klines &res, int res_code, const std::string &res_str) {
+                    if (res_code != 0) {
+                        code = res_code;
+                        str = res_str;
+                    }
+                    pages[page_start].swap(res);
+                });
+            }
+            api.runAsync();
+            if (code != 0) {
+                fprintf(stderr, "klines download: %d %s\n", code, str.c_str());
+                return -1;
+            }
+
+            Klines klines;
+            for (auto &page : pages) {
+                for (auto &kline : page.second) {
+                    // the bar still open would be stored unfinished
+                    if (kline.close_time < now)
+                        klines.push_back(kline);
+                }
+            }
+            std::sort(klines.begin(), klines.end(), [](const Kline &a, const Kline &b) {
+                return a.open_time < b.open_time;
+            });
+            int res = store.append(klines);
+            if (res == -1)
+                return -1;
+            appended += res;
+        }
+        return appended;
+    }
+};
+
+#endif // MEXC_HISTORY_HPP
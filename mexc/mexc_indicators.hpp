@@ -0,0 +1,346 @@
+#ifndef MEXC_INDICATORS_HPP
+#define MEXC_INDICATORS_HPP
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+
+// Incremental indicators: update() takes the next bar in O(1) and
+// nothing is allocated after construction. value() is meaningful once
+// ready() is true, after 'period' bars.
+
+// Fixed capacity ring buffer, the oldest value is overwritten when full.
+template<typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(size_t capacity) : values(std::max<size_t>(capacity, 1)), head{0}, count{0} {
+    }
+
+    void push(const T &value) {
+        values[head] = value;
+        head = (head + 1) % values.size();
+        if (count < values.size())
+            count++;
+    }
+
+    // 0 is the newest value
+    const T &back(size_t i = 0) const {
+        return values[(head + values.size() - 1 - i) % values.size()];
+    }
+
+    // 0 is the oldest value
+    const T &operator[](size_t i) const {
+        return values[(head + values.size() - count + i) % values.size()];
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t capacity() const {
+        return values.size();
+    }
+
+    bool full() const {
+        return count == values.size();
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+private:
+    std::vector<T> values;
+    size_t head;
+    size_t count;
+};
+
+class Sma
+{
+public:
+    explicit Sma(int period) : window(period), sum{0} {
+    }
+
+    double update(double x) {
+        if (window.full())
+            sum -= window[0];
+        sum += x;
+        window.push(x);
+        return value();
+    }
+
+    bool ready() const {
+        return window.full();
+    }
+
+    double value() const {
+        return window.size() ? sum / window.size() : 0;
+    }
+
+private:
+    RingBuffer<double> window;
+    double sum;
+};
+
+// seeded with the SMA of the first 'period' values
+class Ema
+{
+public:
+    explicit Ema(int period) : period{std::max(period, 1)}, alpha{2.0 / (std::max(period, 1) + 1)}, count{0}, ema{0} {
+    }
+
+    double update(double x) {
+        if (count < period) {
+            ema += (x - ema) / ++count;
+            return ema;
+        }
+        ema += alpha * (x - ema);
+        return ema;
+    }
+
+    bool ready() const {
+        return count >= period;
+    }
+
+    double value() const {
+        return ema;
+    }
+
+private:
+    int period;
+    double alpha;
+    int count;
+    double ema;
+};
+
+// population standard deviation of the last 'period' values, with the
+// sliding window form of Welford's update, which stays accurate for prices
+// far from zero unlike sums of squares
+class RollingStd
+{
+public:
+    explicit RollingStd(int period) : window(period), avg{0}, m2{0} {
+    }
+
+    double update(double x) {
+        if (!window.full()) {
+            double delta = x - avg;
+            avg += delta / (window.size() + 1);
+            m2 += delta * (x - avg);
+        }
+        else {
+            double old = window[0];
+            double old_avg = avg;
+            avg += (x - old) / window.size();
+            m2 += (x - old) * (x - avg + old - old_avg);
+        }
+        window.push(x);
+        return value();
+    }
+
+    bool ready() const {
+        return window.full();
+    }
+
+    double mean() const {
+        return avg;
+    }
+
+    double value() const {
+        return window.size() ? sqrt(std::max(m2, 0.0) / window.size()) : 0;
+    }
+
+private:
+    RingBuffer<double> window;
+    double avg;
+    double m2;
+};
+
+// Wilder's RSI, 0..100
+class Rsi
+{
+public:
+    explicit Rsi(int period) : period{std::max(period, 1)}, count{0}, last{0}, gain{0}, loss{0} {
+    }
+
+    double update(double close) {
+        if (count++ == 0) {
+            last = close;
+            return value();
+        }
+        double change = close - last;
+        last = close;
+        double up = change > 0 ? change : 0;
+        double down = change < 0 ? -change : 0;
+        if (count <= period + 1) {
+            // the first average is a simple one
+            gain += (up - gain) / (count - 1);
+            loss += (down - loss) / (count - 1);
+        }
+        else {
+            gain = (gain * (period - 1) + up) / period;
+            loss = (loss * (period - 1) + down) / period;
+        }
+        return value();
+    }
+
+    bool ready() const {
+        return count > period;
+    }
+
+    double value() const {
+        if (loss == 0)
+            return gain == 0 ? 50 : 100;
+        return 100 - 100 / (1 + gain / loss);
+    }
+
+private:
+    int period;
+    int count;
+    double last;
+    double gain;
+    double loss;
+};
+
+// Wilder's average true range
+class Atr
+{
+public:
+    explicit Atr(int period) : period{std::max(period, 1)}, count{0}, last_close{0}, atr{0} {
+    }
+
+    double update(double high, double low, double close) {
+        double range = high - low;
+        if (count > 0)
+            range = std::max(range, std::max(fabs(high - last_close), fabs(low - last_close)));
+        last_close = close;
+        count++;
+        if (count <= period)
+            atr += (range - atr) / count;
+        else
+            atr = (atr * (period - 1) + range) / period;
+        return atr;
+    }
+
+    bool ready() const {
+        return count >= period;
+    }
+
+    double value() const {
+        return atr;
+    }
+
+private:
+    int period;
+    int count;
+    double last_close;
+    double atr;
+};
+
+// volume weighted average of the typical price (high + low + close) / 3
+// over the last 'period' bars
+class Vwap
+{
+public:
+    explicit Vwap(int period) : window(period), price_volume{0}, volume{0} {
+    }
+
+    double update(double high, double low, double close, double bar_volume) {
+        Bar bar = {(high + low + close) / 3 * bar_volume, bar_volume};
+        if (window.full()) {
+            price_volume -= window[0].price_volume;
+            volume -= window[0].volume;
+        }
+        price_volume += bar.price_volume;
+        volume += bar.volume;
+        window.push(bar);
+        return value();
+    }
+
+    bool ready() const {
+        return window.full();
+    }
+
+    double value() const {
+        return volume > 0 ? price_volume / volume : 0;
+    }
+
+private:
+    struct Bar {
+        double price_volume;
+        double volume;
+    };
+
+    RingBuffer<Bar> window;
+    double price_volume;
+    double volume;
+};
+
+// Minimum (or maximum with Compare = std::greater) of the last 'period'
+// values, kept in a monotonic deque of candidates on a ring buffer.
+template<typename Compare>
+class RollingExtremum
+{
+public:
+    explicit RollingExtremum(int period)
+        : period{(size_t)std::max(period, 1)}, candidates(std::max(period, 1)), first{0}, size{0}, index{0} {
+    }
+
+    double update(double x) {
+        // drop the candidates out of the window
+        while (size && candidates[first].index + period <= index)
+            popFront();
+        // and those 'x' beats
+        Compare better;
+        while (size && !better(back().value, x))
+            popBack();
+        candidates[(first + size) % candidates.size()] = {index, x};
+        size++;
+        index++;
+        return value();
+    }
+
+    bool ready() const {
+        return index >= period;
+    }
+
+    double value() const {
+        return size ? candidates[first].value : 0;
+    }
+
+private:
+    struct Candidate {
+        size_t index;
+        double value;
+    };
+
+    const Candidate &back() const {
+        return candidates[(first + size - 1) % candidates.size()];
+    }
+
+    void popFront() {
+        first = (first + 1) % candidates.size();
+        size--;
+    }
+
+    void popBack() {
+        size--;
+    }
+
+private:
+    size_t period;
+    std::vector<Candidate> candidates;
+    size_t first;
+    size_t size;
+    // of the next value
+    size_t index;
+};
+
+using RollingMin = RollingExtremum<std::less<double>>;
+using RollingMax = RollingExtremum<std::greater<double>>;
+
+#endif // MEXC_INDICATORS_HPP
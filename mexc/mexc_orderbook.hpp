@@ -0,0 +1,381 @@
+#ifndef MEXC_ORDERBOOK_HPP
+#define MEXC_ORDERBOOK_HPP
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <map>
+#include "mexc.hpp"
+#include "mexc_stream.hpp"
+
+// Local L2 order book of one symbol, kept from a REST snapshot and
+// the versioned diffs of the increase.depth channel.
+// Each side is a flat array sorted with the best level last,
+// so the best level and the ith best level are read in O(1),
+// and most updates, which are near the top, move few levels.
+class OrderBook
+{
+public:
+    OrderBook() : synced{false}, last_version{0} {
+    }
+
+    // replace the book by 'snapshot' and apply the buffered diffs after it
+    void applySnapshot(const FixedDepth &snapshot) {
+        // snapshot levels are best first
+        bids.assign(snapshot.bids.rbegin(), snapshot.bids.rend());
+        asks.assign(snapshot.asks.rbegin(), snapshot.asks.rend());
+        last_version = snapshot.lastUpdateId;
+        synced = true;
+
+        std::deque<Diff> diffs;
+        diffs.swap(pending);
+        for (size_t i = 0; i < diffs.size(); i++) {
+            Diff &diff = diffs[i];
+            if (diff.version <= last_version)
+                continue;
+            if (!applyDiff(diff.version, diff.bids.data(), diff.bids.size(), diff.asks.data(), diff.asks.size())) {
+                // a version is missing again, applyDiff buffered this diff,
+                // keep the later ones for the next snapshot too
+                for (i++; i < diffs.size(); i++)
+                    pending.push_back(std::move(diffs[i]));
+                break;
+            }
+        }
+    }
+
+    // Apply the levels changed in 'version', qty 0 removes a level.
+    // Diffs not after the snapshot are ignored. Return false if a version
+    // is missing: the book is out of sync and buffers diffs until the
+    // next snapshot.
+    bool applyDiff(int64_t version, const FixedLevel *bid_levels, size_t bid_size,
+                   const FixedLevel *ask_levels, size_t ask_size) {
+        if (synced && version <= last_version)
+            return true;
+        if (synced && version != last_version + 1)
+            synced = false;
+
+        if (!synced) {
+            if (pending.size() == MAX_PENDING)
+                pending.pop_front();
+            pending.push_back(Diff());
+            Diff &diff = pending.back();
+            diff.version = version;
+            diff.bids.assign(bid_levels, bid_levels + bid_size);
+            diff.asks.assign(ask_levels, ask_levels + ask_size);
+            return false;
+        }
+
+        for (size_t i = 0; i < bid_size; i++)
+            update(bids, bid_levels[i], true);
+        for (size_t i = 0; i < ask_size; i++)
+            update(asks, ask_levels[i], false);
+        last_version = version;
+        return true;
+    }
+
+    bool isSynced() const {
+        return synced;
+    }
+
+    int64_t version() const {
+        return last_version;
+    }
+
+    size_t bidSize() const {
+        return bids.size();
+    }
+
+    size_t askSize() const {
+        return asks.size();
+    }
+
+    // the ith best level, i < bidSize() or askSize()
+    const FixedLevel &bid(size_t i) const {
+        return bids[bids.size() - 1 - i];
+    }
+
+    const FixedLevel &ask(size_t i) const {
+        return asks[asks.size() - 1 - i];
+    }
+
+    // copy at most 'n' best levels to 'out', best first, return the number copied
+    size_t topBids(FixedLevel *out, size_t n) const {
+        return top(bids, out, n);
+    }
+
+    size_t topAsks(FixedLevel *out, size_t n) const {
+        return top(asks, out, n);
+    }
+
+    void clear() {
+        bids.clear();
+        asks.clear();
+        pending.clear();
+        synced = false;
+        last_version = 0;
+    }
+
+private:
+    struct Diff {
+        int64_t version;
+        std::vector<FixedLevel> bids;
+        std::vector<FixedLevel> asks;
+    };
+
+    static const size_t MAX_PENDING = 10000;
+
+    // bids ascend and asks descend by price, so the best is last
+    static void update(std::vector<FixedLevel> &side, const FixedLevel &level, bool ascending) {
+        // search from the top, where most updates are
+        auto it = side.end();
+        if (ascending) {
+            while (it != side.begin() && (it - 1)->price > level.price)
+                --it;
+        }
+        else {
+            while (it != side.begin() && (it - 1)->price < level.price)
+                --it;
+        }
+
+        if (it != side.begin() && (it - 1)->price == level.price) {
+            if (level.qty == 0)
+                side.erase(it - 1);
+            else
+                (it - 1)->qty = level.qty;
+        }
+        else if (level.qty != 0) {
+            side.insert(it, level);
+        }
+    }
+
+    static size_t top(const std::vector<FixedLevel> &side, FixedLevel *out, size_t n) {
+        n = std::min(n, side.size());
+        for (size_t i = 0; i < n; i++)
+            out[i] = side[side.size() - 1 - i];
+        return n;
+    }
+
+private:
+    std::vector<FixedLevel> bids;
+    std::vector<FixedLevel> asks;
+    // diffs received while out of sync
+    std::deque<Diff> pending;
+    bool synced;
+    int64_t last_version;
+};
+
+// Order books by symbol, fed by MexcStream::onDepthMessage and resynced
+// from MexcApi::getDepth when a book is out of sync. Prices and quantities
+// are decoded from the messages straight to fixed point.
+class OrderBooks
+{
+public:
+    // 'api' may be NULL when replaying
+    explicit OrderBooks(MexcApi *api) : api{api}, record_file{NULL} {
+    }
+
+    ~OrderBooks() {
+        if (record_file)
+            fclose(record_file);
+    }
+
+    OrderBooks(const OrderBooks &) = delete;
+    OrderBooks &operator=(const OrderBooks &) = delete;
+
+    void add(std::string symbol, const FixedScale &scale, int limit = 1000) {
+        Entry &entry = books[symbol];
+        entry.scale = scale;
+        entry.limit = limit;
+        entry.next_resync_ms = 0;
+        entry.resync_delay_ms = 0;
+    }
+
+    OrderBook *book(const std::string &symbol) {
+        auto it = books.find(symbol);
+        return it == books.end() ? NULL : &it->second.book;
+    }
+
+    const FixedScale *scale(const std::string &symbol) const {
+        auto it = books.find(symbol);
+        return it == books.end() ? NULL : &it->second.scale;
+    }
+
+    // append snapshots to 'path', next to the depth messages recorded by
+    // MexcStream::record, for replay()
+    bool record(std::string path) {
+        if (record_file)
+            fclose(record_file);
+        record_file = fopen(path.c_str(), "a");
+        return record_file != NULL;
+    }
+
+    void applySnapshot(const std::string &symbol, const FixedDepth &snapshot) {
+        auto it = books.find(symbol);
+        if (it != books.end())
+            it->second.book.applySnapshot(snapshot);
+    }
+
+    // A message of the increase.depth channel, resyncs the book if needed.
+    // Return false if it is not a depth message of a book.
+    bool onDepthMessage(const std::string &message) {
+        Entry *entry = apply(message);
+        if (!entry)
+            return false;
+        if (!entry->book.isSynced() && api)
+            resync(message_symbol, *entry);
+        return true;
+    }
+
+    // Apply a file written by MexcStream::record and OrderBooks::record
+    // in order, return the number of messages applied.
+    size_t replay(std::string path) {
+        std::ifstream file(path);
+        std::string line;
+        size_t count = 0;
+        while (std::getline(file, line)) {
+            if (apply(line))
+                count++;
+        }
+        return count;
+    }
+
+private:
+    struct Entry {
+        OrderBook book;
+        FixedScale scale;
+        int limit;
+        // resyncs are spaced by 'resync_delay_ms', which grows while they fail
+        int64_t next_resync_ms;
+        int64_t resync_delay_ms;
+    };
+
+    static constexpr const char *SNAPSHOT_CHANNEL = "snapshot";
+
+    static int64_t nowMs() {
+        return duration_cast<milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Apply a depth or snapshot message of a book, return the book or NULL.
+    // Messages are {"c": channel, "s": symbol, "d": data, ...}, "d" may come
+    // before "s", so it is decoded once the scale of the symbol is known.
+    Entry *apply(const std::string &message) {
+        JsonCursor cur(message);
+        const char *channel = NULL;
+        size_t channel_size = 0;
+        const char *d = NULL;
+        const char *d_end = NULL;
+        message_symbol.clear();
+        if (!cur.consume('{') || cur.consume('}'))
+            return NULL;
+        do {
+            const char *k;
+            size_t n;
+            if (!cur.key(k, n))
+                return NULL;
+            if (keyIs(k, n, "c")) {
+                if (!cur.string(channel, channel_size))
+                    return NULL;
+            }
+            else if (keyIs(k, n, "s")) {
+                const char *s;
+                size_t len;
+                if (!cur.string(s, len))
+                    return NULL;
+                message_symbol.assign(s, len);
+            }
+            else if (keyIs(k, n, "d")) {
+                cur.skipSpace();
+                d = cur.position();
+                if (!cur.skipValue())
+                    return NULL;
+                d_end = cur.position();
+            }
+            else if (!cur.skipValue()) {
+                return NULL;
+            }
+        } while (cur.consume(','));
+        if (!channel || !d)
+            return NULL;
+
+        auto it = books.find(message_symbol);
+        if (it == books.end())
+            return NULL;
+        Entry &entry = it->second;
+
+        if (keyIs(channel, channel_size, SNAPSHOT_CHANNEL)) {
+            if (!MexcApi::decodeDepth(d, d_end, entry.scale, snapshot))
+                return NULL;
+            entry.book.applySnapshot(snapshot);
+            return &entry;
+        }
+        if (channel_size < strlen(WS_DEPTH_CHANNEL) || memcmp(channel, WS_DEPTH_CHANNEL, strlen(WS_DEPTH_CHANNEL)) != 0)
+            return NULL;
+        if (!MexcApi::decodeDepthUpdate(d, d_end, entry.scale, update))
+            return NULL;
+        entry.book.applyDiff(update.lastUpdateId, update.bids.data(), update.bids.size(),
+                             update.asks.data(), update.asks.size());
+        return &entry;
+    }
+
+    // in the shape of the depth response, for MexcApi::decodeDepth
+    void recordSnapshot(const std::string &symbol, const FixedScale &scale) {
+        fprintf(record_file, "{\"c\":\"%s\",\"s\":\"%s\",\"d\":{\"lastUpdateId\":%lld,\"bids\":[",
+                SNAPSHOT_CHANNEL, symbol.c_str(), (long long)snapshot.lastUpdateId);
+        recordLevels(snapshot.bids, scale);
+        fprintf(record_file, "],\"asks\":[");
+        recordLevels(snapshot.asks, scale);
+        fprintf(record_file, "]}}\n");
+        fflush(record_file);
+    }
+
+    void recordLevels(const std::vector<FixedLevel> &levels, const FixedScale &scale) {
+        for (size_t i = 0; i < levels.size(); i++) {
+            fprintf(record_file, "%s[", i ? "," : "");
+            recordFixed(levels[i].price, scale.price);
+            fputc(',', record_file);
+            recordFixed(levels[i].qty, scale.qty);
+            fputc(']', record_file);
+        }
+    }
+
+    // exactly, as a quoted decimal
+    void recordFixed(int64_t value, int scale) {
+        uint64_t power = 1;
+        for (int i = 0; i < scale; i++)
+            power *= 10;
+        uint64_t v = value < 0 ? -(uint64_t)value : (uint64_t)value;
+        fprintf(record_file, "\"%s%llu", value < 0 ? "-" : "", (unsigned long long)(v / power));
+        if (scale > 0)
+            fprintf(record_file, ".%0*llu", scale, (unsigned long long)(v % power));
+        fputc('"', record_file);
+    }
+
+    // Every diff of an out of sync book would fetch a snapshot, blocking
+    // the stream, so they are at least 1 s apart, and up to 30 s while
+    // they fail. A snapshot older than the buffered diffs leaves the book
+    // out of sync, the next one comes 1 s later.
+    void resync(const std::string &symbol, Entry &entry) {
+        int64_t now = nowMs();
+        if (now < entry.next_resync_ms)
+            return;
+        bool ok = api->getDepth(snapshot, entry.scale, symbol, entry.limit);
+        entry.resync_delay_ms = ok ? 1000 : std::min<int64_t>(std::max<int64_t>(entry.resync_delay_ms * 2, 1000), 30000);
+        entry.next_resync_ms = nowMs() + entry.resync_delay_ms;
+        if (!ok)
+            return;
+        if (record_file)
+            recordSnapshot(symbol, entry.scale);
+        entry.book.applySnapshot(snapshot);
+    }
+
+private:
+    MexcApi *api;
+    std::map<std::string, Entry> books;
+    FILE *record_file;
+    // reused buffers
+    std::string message_symbol;
+    FixedDepth snapshot;
+    FixedDepth update;
+};
+
+#endif // MEXC_ORDERBOOK_HPP
@@ -0,0 +1,140 @@
+#ifndef MEXC_RATELIMIT_HPP
+#define MEXC_RATELIMIT_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <stdint.h>
+
+// Token bucket of request weight, refilled continuously with 'capacity'
+// tokens per 'interval_ms'. Market data may not take the last
+// 'order_reserve' tokens, so orders still go out when polling uses up
+// the limit. Calls over the limit wait for tokens instead of failing.
+class RateLimiter
+{
+public:
+    enum class Priority {
+        ORDER,
+        MARKET_DATA
+    };
+
+    struct Stats {
+        // requests that got their tokens
+        uint64_t requests;
+        // requests that had to wait for them
+        uint64_t delayed;
+        // 429 responses
+        uint64_t throttled;
+        uint64_t wait_us;
+        uint64_t max_wait_us;
+        // requests waiting now
+        size_t queue_depth;
+        size_t max_queue_depth;
+    };
+
+    // MEXC allows 500 weight per 10 seconds per IP
+    RateLimiter(int capacity = 500, int interval_ms = 10000, int order_reserve = 50) {
+        setLimit(capacity, interval_ms, order_reserve);
+        tokens = capacity;
+        last = now();
+        paused_until[0] = 0;
+        paused_until[1] = 0;
+        stats_ = Stats();
+    }
+
+    void setLimit(int capacity, int interval_ms, int order_reserve) {
+        this->capacity = std::max(capacity, 1);
+        this->order_reserve = std::min(std::max(order_reserve, 0), this->capacity - 1);
+        rate = (double)this->capacity / (std::max(interval_ms, 1) * 1000.0);
+    }
+
+    // microseconds until 'weight' can be taken, 0 if now
+    int64_t delay(int weight, Priority priority) {
+        int64_t t = now();
+        refill(t);
+        double need = clamp(weight, priority) + (priority == Priority::ORDER ? 0 : order_reserve);
+        int64_t wait = tokens >= need ? 0 : (int64_t)((need - tokens) / rate) + 1;
+        return std::max(wait, paused_until[(int)priority] - t);
+    }
+
+    bool tryAcquire(int weight, Priority priority) {
+        if (delay(weight, priority) > 0)
+            return false;
+        tokens -= clamp(weight, priority);
+        stats_.requests++;
+        return true;
+    }
+
+    // wait until 'weight' can be taken and take it
+    void acquire(int weight, Priority priority) {
+        if (tryAcquire(weight, priority))
+            return;
+        int64_t start = now();
+        enqueue();
+        int64_t wait;
+        while ((wait = delay(weight, priority)) > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(wait));
+        tokens -= clamp(weight, priority);
+        stats_.requests++;
+        dequeue(now() - start);
+    }
+
+    // The exchange answered 429 to a request of 'priority', take nothing
+    // of it for 'ms'. Orders keep their reserve through a market data pause;
+    // a 429 to an order pauses everything.
+    void pause(int64_t ms, Priority priority) {
+        int64_t until = now() + ms * 1000;
+        paused_until[(int)Priority::MARKET_DATA] = std::max(paused_until[(int)Priority::MARKET_DATA], until);
+        if (priority == Priority::ORDER) {
+            paused_until[(int)Priority::ORDER] = std::max(paused_until[(int)Priority::ORDER], until);
+            tokens = 0;
+        }
+        stats_.throttled++;
+    }
+
+    // accounting of requests queued by the caller, like async requests
+    void enqueue() {
+        stats_.delayed++;
+        stats_.queue_depth++;
+        stats_.max_queue_depth = std::max(stats_.max_queue_depth, stats_.queue_depth);
+    }
+
+    void dequeue(int64_t waited_us) {
+        stats_.queue_depth--;
+        stats_.wait_us += waited_us;
+        stats_.max_wait_us = std::max<uint64_t>(stats_.max_wait_us, waited_us);
+    }
+
+    const Stats &stats() const {
+        return stats_;
+    }
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    void refill(int64_t t) {
+        tokens = std::min<double>(capacity, tokens + (t - last) * rate);
+        last = t;
+    }
+
+    // a weight over the limit would wait forever
+    int clamp(int weight, Priority priority) const {
+        return std::min(weight, capacity - (priority == Priority::ORDER ? 0 : order_reserve));
+    }
+
+private:
+    int capacity;
+    int order_reserve;
+    // tokens per microsecond
+    double rate;
+    double tokens;
+    int64_t last;
+    // by Priority
+    int64_t paused_until[2];
+    Stats stats_;
+};
+
+#endif // MEXC_RATELIMIT_HPP
@@ -0,0 +1,273 @@
+#ifndef MEXC_REPLAY_HPP
+#define MEXC_REPLAY_HPP
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+
+// Local WebSocket server replaying messages recorded by MexcStream::record,
+// for running MexcStream without the exchange.
+// Every connection gets the whole file after its first (subscription)
+// message, then the server closes it, so clients see a reconnect.
+class MexcReplayServer
+{
+public:
+    MexcReplayServer(std::string path, int interval_ms = 0) : interval_ms{interval_ms} {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty())
+                messages.push_back(line);
+        }
+        listen_fd = -1;
+        listen_port = 0;
+        stopping = false;
+    }
+
+    ~MexcReplayServer() {
+        stop();
+    }
+
+    MexcReplayServer(const MexcReplayServer &) = delete;
+    MexcReplayServer &operator=(const MexcReplayServer &) = delete;
+
+    size_t size() const {
+        return messages.size();
+    }
+
+    // listen on 127.0.0.1:port (0: any free port), return false on failure
+    bool start(int port = 0) {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd == -1)
+            return false;
+        int on = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        socklen_t len = sizeof(addr);
+        if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+                || listen(listen_fd, 4) == -1
+                || getsockname(listen_fd, (struct sockaddr *)&addr, &len) == -1) {
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        listen_port = ntohs(addr.sin_port);
+
+        thread = std::thread([this] { serve(); });
+        return true;
+    }
+
+    void stop() {
+        stopping = true;
+        if (thread.joinable())
+            thread.join();
+        if (listen_fd != -1) {
+            close(listen_fd);
+            listen_fd = -1;
+        }
+    }
+
+    int port() const {
+        return listen_port;
+    }
+
+    std::string url() const {
+        return "ws://127.0.0.1:" + std::to_string(listen_port) + "/ws";
+    }
+
+private:
+    // wait until 'fd' is readable or stop() is called
+    bool waitReadable(int fd) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        while (!stopping) {
+            pfd.revents = 0;
+            if (::poll(&pfd, 1, 100) > 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool readFully(int fd, void *data, size_t size) {
+        char *p = (char *)data;
+        while (size) {
+            if (!waitReadable(fd))
+                return false;
+            ssize_t n = read(fd, p, size);
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool writeFully(int fd, const void *data, size_t size) {
+        const char *p = (const char *)data;
+        while (size) {
+            ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    bool handshake(int fd) {
+        std::string request;
+        char c;
+        while (request.size() < 8192 && request.find("\r\n\r\n") == std::string::npos) {
+            if (!readFully(fd, &c, 1))
+                return false;
+            request += c;
+        }
+
+        std::string key;
+        size_t pos = 0;
+        while ((pos = request.find("\r\n", pos)) != std::string::npos) {
+            pos += 2;
+            size_t colon = request.find(':', pos);
+            size_t end = request.find("\r\n", pos);
+            if (colon == std::string::npos || end == std::string::npos || colon > end)
+                continue;
+            std::string name = request.substr(pos, colon - pos);
+            for (auto &ch : name)
+                ch = tolower(ch);
+            if (name == "sec-websocket-key") {
+                key = request.substr(colon + 1, end - colon - 1);
+                key.erase(0, key.find_first_not_of(' '));
+                key.erase(key.find_last_not_of(' ') + 1);
+            }
+        }
+        if (key.empty())
+            return false;
+
+        key += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+        unsigned char digest[20];
+        mbedtls_sha1((const unsigned char *)key.data(), key.size(), digest);
+        unsigned char accept[64];
+        size_t accept_size = 0;
+        mbedtls_base64_encode(accept, sizeof(accept), &accept_size, digest, sizeof(digest));
+
+        std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                               "Upgrade: websocket\r\n"
+                               "Connection: Upgrade\r\n"
+                               "Sec-WebSocket-Accept: " + std::string((char *)accept, accept_size) + "\r\n\r\n";
+        return writeFully(fd, response.data(), response.size());
+    }
+
+    // read one masked client frame and drop it
+    bool readFrame(int fd) {
+        unsigned char header[2];
+        if (!readFully(fd, header, 2))
+            return false;
+        uint64_t size = header[1] & 0x7f;
+        if (size == 126) {
+            unsigned char ext[2];
+            if (!readFully(fd, ext, 2))
+                return false;
+            size = (ext[0] << 8) | ext[1];
+        }
+        else if (size == 127) {
+            unsigned char ext[8];
+            if (!readFully(fd, ext, 8))
+                return false;
+            size = 0;
+            for (int i = 0; i < 8; i++)
+                size = (size << 8) | ext[i];
+        }
+        if (header[1] & 0x80) {
+            unsigned char mask[4];
+            if (!readFully(fd, mask, 4))
+                return false;
+        }
+        std::vector<char> payload(size);
+        return size == 0 || readFully(fd, payload.data(), size);
+    }
+
+    // write an unmasked frame, opcode 1: text, 8: close
+    bool writeFrame(int fd, int opcode, const std::string &payload) {
+        std::string frame;
+        frame += (char)(0x80 | opcode);
+        size_t size = payload.size();
+        if (size < 126) {
+            frame += (char)size;
+        }
+        else if (size < 65536) {
+            frame += (char)126;
+            frame += (char)(size >> 8);
+            frame += (char)(size & 0xff);
+        }
+        else {
+            frame += (char)127;
+            for (int i = 7; i >= 0; i--)
+                frame += (char)((uint64_t)size >> (i * 8));
+        }
+        frame += payload;
+        return writeFully(fd, frame.data(), frame.size());
+    }
+
+    // closing a socket with unread input resets the connection and drops
+    // the frames the client has not read yet, so read until the client closes
+    void drain(int fd) {
+        shutdown(fd, SHUT_WR);
+        char buffer[4096];
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        for (int i = 0; i < 10 && !stopping; i++) {
+            pfd.revents = 0;
+            if (::poll(&pfd, 1, 100) > 0 && read(fd, buffer, sizeof(buffer)) <= 0)
+                break;
+        }
+    }
+
+    void serve() {
+        while (!stopping) {
+            if (!waitReadable(listen_fd))
+                break;
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd == -1)
+                continue;
+
+            if (handshake(fd) && readFrame(fd)) {
+                for (auto &message : messages) {
+                    if (stopping || !writeFrame(fd, 1, message))
+                        break;
+                    if (interval_ms)
+                        usleep(interval_ms * 1000);
+                }
+                writeFrame(fd, 8, "");
+                drain(fd);
+            }
+            close(fd);
+        }
+    }
+
+private:
+    std::vector<std::string> messages;
+    const int interval_ms;
+    int listen_fd;
+    int listen_port;
+    std::atomic<bool> stopping;
+    std::thread thread;
+};
+
+#endif // MEXC_REPLAY_HPP
@@ -0,0 +1,157 @@
+#ifndef MEXC_RETRAINER_HPP
+#define MEXC_RETRAINER_HPP
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <stdlib.h>
+#include <thread>
+#include "../gbdt/gbdt.h"
+#include "mexc_features.hpp"
+
+// Training rows of 'closes' into 'rows' (row-major) and 'set': x is
+// Features, y is +1 if the close is higher a random 0..max-1 bars later.
+// 'seed' is for rand_r, rand() is used if it is NULL.
+// Return -1 if there are too few bars.
+inline int makeTrainingSet(const double *closes, size_t size, int input, int inputSma, int max,
+                           std::vector<double> &rows, XYSet &set, unsigned *seed = NULL) {
+    Features features(input, inputSma);
+    size_t columns = features.size();
+    rows.clear();
+
+    for (int i = 0; i + max < (int)size; i++)
+    {
+        if (!features.update(closes[i]) || i < input + inputSma)
+            continue;
+
+        auto h = i + (seed ? rand_r(seed) : rand()) % max;
+
+        double y = (closes[h] > closes[i]) ? 1.0 : -1.0;
+
+        size_t row = rows.size();
+        rows.resize(row + columns);
+        features.get(&rows[row]);
+
+        set.add(&rows[row], columns, y);
+    }
+
+    return set.finalize();
+}
+
+// Retrains the model on the last bars on a background thread every
+// 'every' bars, and publishes each new model with an atomic shared_ptr
+// store. model() is an atomic load, so the trading path never waits for
+// training or loading; a model stays alive while a caller still holds it.
+class Retrainer
+{
+public:
+    // 'model_path' (may be empty) gets each new model in the binary format,
+    // written to a temporary file and renamed over it
+    Retrainer(const TreeParam &param, int input, int inputSma, int max, int every, size_t history_size,
+              std::string model_path = "")
+        : param{param}, input{input}, inputSma{inputSma}, max{max}, every{every},
+          history_size{history_size}, model_path{model_path}, bars{0}, running{false}, published{0}, random_seed{1} {
+        this->param.verbose = 0;
+        // one core, as the trading thread and the stream must not wait for it
+        this->param.num_threads = 1;
+    }
+
+    ~Retrainer() {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    Retrainer(const Retrainer &) = delete;
+    Retrainer &operator=(const Retrainer &) = delete;
+
+    std::shared_ptr<const GBDTPredictor> model() const {
+        return std::atomic_load(&current);
+    }
+
+    void publish(std::shared_ptr<const GBDTPredictor> model) {
+        std::atomic_store(&current, model);
+    }
+
+    // add a closed bar to the history without counting it
+    void addHistory(double close) {
+        history.push_back(close);
+        if (history.size() > history_size)
+            history.pop_front();
+    }
+
+    // add a closed bar, start a retraining every 'every' bars unless
+    // one is still running; never if 'every' is not positive
+    void onBar(double close) {
+        addHistory(close);
+        if (every <= 0 || ++bars < every || running)
+            return;
+        bars = 0;
+        if (thread.joinable())
+            thread.join();
+        running = true;
+        std::vector<double> closes(history.begin(), history.end());
+        thread = std::thread([this, closes] {
+            train(closes);
+            running = false;
+        });
+    }
+
+    // retrainings finished
+    size_t generation() const {
+        return published;
+    }
+
+private:
+    // the trainer refers to its set, so they live and die together
+    struct Trained {
+        XYSet set;
+        // made once the set is complete
+        std::unique_ptr<GBDTTrainer> trainer;
+    };
+
+    void train(const std::vector<double> &closes) {
+        std::shared_ptr<Trained> trained(new Trained);
+        std::vector<double> rows;
+        if (makeTrainingSet(closes.data(), closes.size(), input, inputSma, max, rows, trained->set, &random_seed) == -1)
+            return;
+        if (param.gbdt_histogram_bins)
+            limit_x_values(&trained->set, param.gbdt_histogram_bins);
+        trained->trainer.reset(new GBDTTrainer(trained->set, param));
+        if (trained->trainer->train() == -1)
+            return;
+
+        if (!model_path.empty()) {
+            std::string tmp = model_path + ".tmp";
+            FILE *fp = fopen(tmp.c_str(), "wb");
+            if (fp) {
+                int ret = trained->trainer->save_binary(fp);
+                fclose(fp);
+                // a model mapped from the old file keeps its pages
+                if (ret != -1)
+                    rename(tmp.c_str(), model_path.c_str());
+            }
+        }
+
+        publish(std::shared_ptr<const GBDTPredictor>(trained, trained->trainer.get()));
+        published++;
+    }
+
+private:
+    TreeParam param;
+    const int input;
+    const int inputSma;
+    const int max;
+    const int every;
+    const size_t history_size;
+    const std::string model_path;
+    std::shared_ptr<const GBDTPredictor> current;
+    std::deque<double> history;
+    int bars;
+    std::atomic<bool> running;
+    std::atomic<size_t> published;
+    // of the training rows' y
+    unsigned random_seed;
+    std::thread thread;
+};
+
+#endif // MEXC_RETRAINER_HPP
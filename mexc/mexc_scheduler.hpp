@@ -0,0 +1,196 @@
+#ifndef MEXC_SCHEDULER_HPP
+#define MEXC_SCHEDULER_HPP
+
+#include <atomic>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "mexc.hpp"
+#include "mexc_history.hpp"
+
+// Event loop calling back at the bar closes of any number of symbol and
+// interval pairs. One timerfd is armed for the nearest close on the
+// exchange clock, so the loop sleeps until then instead of polling; pairs
+// closing together are called back in the same wakeup.
+class BarScheduler
+{
+public:
+    using BarCallback = std::function<void(const std::string &symbol, const std::string &interval,
+                                           int64_t open_time)>;
+
+    // 'api' (may be NULL) gives the exchange clock, resynced every hour;
+    // callbacks come 'delay_ms' after a close, for the exchange to close the bar
+    explicit BarScheduler(MexcApi *api = NULL, int delay_ms = 20) : api{api}, delay_ms{delay_ms} {
+        offset_ms = 0;
+        last_sync_ms = 0;
+        stopping = false;
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = timer_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+        event.data.fd = wake_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+        if (api)
+            syncClock();
+    }
+
+    ~BarScheduler() {
+        close(wake_fd);
+        close(timer_fd);
+        close(epoll_fd);
+    }
+
+    BarScheduler(const BarScheduler &) = delete;
+    BarScheduler &operator=(const BarScheduler &) = delete;
+
+    // return false for intervals without a fixed length (1M)
+    bool add(std::string symbol, std::string interval, BarCallback callback) {
+        Entry entry;
+        entry.interval_ms = KlineHistory::intervalMs(interval);
+        if (entry.interval_ms == 0)
+            return false;
+        entry.symbol = symbol;
+        entry.interval = interval;
+        // weeks start on Monday, the epoch was a Thursday
+        entry.align_ms = interval == "1W" ? 4 * 86400000LL : 0;
+        entry.callback = callback;
+        entry.next_close = nextClose(entry, serverNow());
+        entries.push_back(entry);
+        arm();
+        return true;
+    }
+
+    // Set the offset of the exchange clock from getTime, taking the
+    // server time at the middle of the round trip.
+    bool syncClock() {
+        int64_t sent = localNow();
+        int64_t server = api->getTime();
+        int64_t received = localNow();
+        if (server == 0)
+            return false;
+        offset_ms = server - (sent + received) / 2;
+        last_sync_ms = received;
+        for (auto &entry : entries)
+            entry.next_close = nextClose(entry, serverNow());
+        arm();
+        return true;
+    }
+
+    // exchange time minus local time
+    int64_t clockOffset() const {
+        return offset_ms;
+    }
+
+    int64_t serverNow() const {
+        return localNow() + offset_ms;
+    }
+
+    // Wait up to 'timeout_ms' (-1: no timeout) for bar closes and call
+    // their callbacks, return the number called, -1 on error.
+    int poll(int timeout_ms = -1) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epoll_fd, events, 2, timeout_ms);
+        if (n == -1)
+            return errno == EINTR ? 0 : -1;
+
+        uint64_t value;
+        for (int i = 0; i < n; i++) {
+            if (read(events[i].data.fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+                return -1;
+        }
+
+        int called = 0;
+        int64_t now = serverNow();
+        for (auto &entry : entries) {
+            if (entry.next_close + delay_ms > now)
+                continue;
+            int64_t open_time = entry.next_close - entry.interval_ms;
+            // closes missed while a callback was running are skipped
+            entry.next_close = nextClose(entry, now);
+            entry.callback(entry.symbol, entry.interval, open_time);
+            called++;
+        }
+
+        if (api && localNow() - last_sync_ms > CLOCK_SYNC_MS)
+            syncClock();
+        arm();
+        return called;
+    }
+
+    // readable when a close is due or stop() was called, to wait for it
+    // together with other descriptors, then call poll(0)
+    int fd() const {
+        return epoll_fd;
+    }
+
+    void run() {
+        while (!stopping) {
+            if (poll() == -1)
+                break;
+        }
+    }
+
+    // may be called from any thread
+    void stop() {
+        stopping = true;
+        uint64_t value = 1;
+        if (write(wake_fd, &value, sizeof(value)) == -1)
+            return;
+    }
+
+private:
+    struct Entry {
+        std::string symbol;
+        std::string interval;
+        int64_t interval_ms;
+        int64_t align_ms;
+        // exchange time of the next close
+        int64_t next_close;
+        BarCallback callback;
+    };
+
+    static const int64_t CLOCK_SYNC_MS = 3600000;
+
+    static int64_t localNow() {
+        return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+    static int64_t nextClose(const Entry &entry, int64_t now) {
+        int64_t t = now - entry.align_ms;
+        return t - t % entry.interval_ms + entry.interval_ms + entry.align_ms;
+    }
+
+    // fire the timer at the nearest close, in local time
+    void arm() {
+        if (entries.empty())
+            return;
+        int64_t next = entries[0].next_close;
+        for (auto &entry : entries)
+            next = std::min(next, entry.next_close);
+        int64_t local = next + delay_ms - offset_ms;
+
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = local / 1000;
+        spec.it_value.tv_nsec = (local % 1000) * 1000000;
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    }
+
+private:
+    MexcApi *api;
+    const int delay_ms;
+    int64_t offset_ms;
+    int64_t last_sync_ms;
+    std::vector<Entry> entries;
+    int epoll_fd;
+    int timer_fd;
+    // wakes poll() up for stop()
+    int wake_fd;
+    std::atomic<bool> stopping;
+};
+
+#endif // MEXC_SCHEDULER_HPP
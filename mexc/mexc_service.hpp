@@ -0,0 +1,320 @@
+#ifndef MEXC_SERVICE_HPP
+#define MEXC_SERVICE_HPP
+
+#include <dirent.h>
+#include <map>
+#include <memory>
+#include <set>
+#include "../gbdt/gbdt.h"
+#include "../gbdt/thread-pool.h"
+#include "mexc.hpp"
+#include "mexc_features.hpp"
+#include "mexc_scheduler.hpp"
+
+// Models of a directory by symbol and period, from files named
+// SYMBOL_PERIOD_model.bin, or SYMBOL_PERIOD_model.dat (JSON) when there is
+// no binary one. Binary models are memory mapped, so their pages are
+// shared with other processes serving the same files.
+// Files of the same contents, copies or links of one model, are loaded
+// once: their symbols share the predictor and are scored in one batch.
+// A model trained per symbol is a batch of one row.
+class ModelRegistry
+{
+public:
+    // return the number of models loaded, -1 on error
+    int load(const std::string &dir, GBDTPredictor::kEngine engine = GBDTPredictor::kEngine_FlatTrees) {
+        DIR *d = opendir(dir.c_str());
+        if (d == NULL) {
+            fprintf(stderr, "can not open %s\n", dir.c_str());
+            return -1;
+        }
+        // file by SYMBOL_PERIOD, a binary model wins over a JSON one
+        std::map<std::string, std::string> files;
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            std::string name = entry->d_name;
+            std::string key;
+            if (endsWith(name, BINARY_SUFFIX))
+                key = name.substr(0, name.size() - strlen(BINARY_SUFFIX));
+            else if (endsWith(name, JSON_SUFFIX))
+                key = name.substr(0, name.size() - strlen(JSON_SUFFIX));
+            if (key.find('_') == std::string::npos)
+                continue;
+            auto it = files.find(key);
+            if (it == files.end() || endsWith(name, BINARY_SUFFIX))
+                files[key] = name;
+        }
+        closedir(d);
+
+        // the first file of each contents and its predictor, by contents hash
+        std::map<size_t, std::vector<std::pair<std::string, std::shared_ptr<GBDTPredictor>>>> loaded_files;
+        std::string contents;
+        std::string other;
+        int loaded = 0;
+        for (auto &file : files) {
+            std::string path = dir + "/" + file.second;
+            if (!readFile(path, contents)) {
+                fprintf(stderr, "can not read %s\n", path.c_str());
+                return -1;
+            }
+            auto &same_hash = loaded_files[std::hash<std::string>()(contents)];
+            std::shared_ptr<GBDTPredictor> model;
+            for (auto &f : same_hash) {
+                if (readFile(f.first, other) && other == contents) {
+                    model = f.second;
+                    break;
+                }
+            }
+            if (model) {
+                models[file.first] = model;
+                loaded++;
+                continue;
+            }
+
+            model.reset(new GBDTPredictor);
+            int ret;
+            if (endsWith(file.second, BINARY_SUFFIX)) {
+                ret = model->load_binary(path.c_str(), engine);
+            }
+            else {
+                FILE *fp = fopen(path.c_str(), "r");
+                ret = fp ? model->load_json(fp, engine) : -1;
+                if (fp)
+                    fclose(fp);
+            }
+            if (ret == -1) {
+                fprintf(stderr, "can not load %s\n", path.c_str());
+                return -1;
+            }
+            same_hash.push_back({path, model});
+            models[file.first] = model;
+            loaded++;
+        }
+        return loaded;
+    }
+
+    // NULL if there is none
+    std::shared_ptr<const GBDTPredictor> find(const std::string &symbol, const std::string &period) const {
+        auto it = models.find(symbol + "_" + period);
+        return it == models.end() ? NULL : it->second;
+    }
+
+    size_t size() const {
+        return models.size();
+    }
+
+    // of different contents
+    size_t distinct() const {
+        std::set<const GBDTPredictor *> predictors;
+        for (auto &model : models)
+            predictors.insert(model.second.get());
+        return predictors.size();
+    }
+
+    // symbol and period of every model
+    std::vector<std::pair<std::string, std::string>> list() const {
+        std::vector<std::pair<std::string, std::string>> res;
+        for (auto &model : models) {
+            size_t pos = model.first.find('_');
+            res.push_back({model.first.substr(0, pos), model.first.substr(pos + 1)});
+        }
+        return res;
+    }
+
+private:
+    static constexpr const char *BINARY_SUFFIX = "_model.bin";
+    static constexpr const char *JSON_SUFFIX = "_model.dat";
+
+    static bool endsWith(const std::string &s, const char *suffix) {
+        size_t n = strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    }
+
+    static bool readFile(const std::string &path, std::string &res) {
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (fp == NULL)
+            return false;
+        res.clear();
+        char buffer[65536];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+            res.append(buffer, n);
+        bool ok = !ferror(fp);
+        fclose(fp);
+        return ok;
+    }
+
+private:
+    // by SYMBOL_PERIOD, shared by the files of the same contents
+    std::map<std::string, std::shared_ptr<GBDTPredictor>> models;
+};
+
+// Signals of many symbols in one process, sharing one MexcApi, one
+// BarScheduler and one worker pool. At each bar close, the closed bars of
+// all symbols of the period are fetched concurrently, then the rows of the
+// symbols sharing a model are scored in one batch, batches spread over
+// the workers. Signals are called back on the calling thread.
+class MexcService
+{
+public:
+    using SignalCallback = std::function<void(const std::string &symbol, const std::string &period, double score)>;
+
+    MexcService(MexcApi &api, const ModelRegistry &models, int input, int inputSma, size_t threads)
+        : api{api}, models{models}, input{input}, inputSma{inputSma}, scheduler{&api}, pool{threads} {
+    }
+
+    MexcService(const MexcService &) = delete;
+    MexcService &operator=(const MexcService &) = delete;
+
+    // return false if there is no model for them or the period is not supported
+    bool add(std::string symbol, std::string period) {
+        auto model = models.find(symbol, period);
+        if (!model || KlineHistory::intervalMs(period) == 0)
+            return false;
+        std::unique_ptr<Market> market(new Market(symbol, period, model, input, inputSma));
+        if (groups.find(period) == groups.end()) {
+            scheduler.add("", period, [this](const std::string &, const std::string &period, int64_t open_time) {
+                onClose(period, open_time);
+            });
+        }
+        groups[period].push_back(market.get());
+        markets.push_back(std::move(market));
+        return true;
+    }
+
+    // add every model of the registry, return the number added
+    size_t addAll() {
+        size_t added = 0;
+        for (auto &key : models.list())
+            added += add(key.first, key.second);
+        return added;
+    }
+
+    void onSignal(SignalCallback callback) {
+        signal_callback = callback;
+    }
+
+    // fill the features with the recent closed bars of every symbol
+    void warmUp(int bars = 50) {
+        int64_t now = scheduler.serverNow();
+        for (auto &market : markets) {
+            Market *m = market.get();
+            api.getKlinesAsync(m->symbol, m->period, 0, 0, bars, [m, now](Klines &klines, int code, const std::string &str) {
+                if (code != 0)
+                    fprintf(stderr, "%s: %d %s\n", m->symbol.c_str(), code, str.c_str());
+                for (auto &kline : klines) {
+                    if (kline.close_time >= now)
+                        break;
+                    m->features.update(kline.close);
+                    m->last_bar = kline.open_time;
+                }
+            });
+        }
+        api.runAsync();
+    }
+
+    void run() {
+        scheduler.run();
+    }
+
+    void stop() {
+        scheduler.stop();
+    }
+
+    size_t size() const {
+        return markets.size();
+    }
+
+private:
+    struct Market {
+        Market(std::string symbol, std::string period, std::shared_ptr<const GBDTPredictor> model, int input, int inputSma)
+            : symbol{symbol}, period{period}, model{model}, features{input, inputSma}, last_bar{0}, has_row{false} {
+        }
+
+        std::string symbol;
+        std::string period;
+        std::shared_ptr<const GBDTPredictor> model;
+        Features features;
+        int64_t last_bar;
+        // the features end with the bar that just closed
+        bool has_row;
+    };
+
+    // rows scored by one worker at a time
+    static const size_t MAX_BATCH = 64;
+
+    void onClose(const std::string &period, int64_t open_time) {
+        std::vector<Market *> &group = groups[period];
+
+        for (auto m : group) {
+            m->has_row = false;
+            // the latest bars if none is known yet, as after a failed warm-up:
+            // bars after startTime 1 are those of the listing
+            api.getKlinesAsync(m->symbol, period, m->last_bar ? m->last_bar + 1 : 0, 0, 50,
+                               [m, open_time](Klines &klines, int code, const std::string &str) {
+                if (code != 0)
+                    fprintf(stderr, "%s: %d %s\n", m->symbol.c_str(), code, str.c_str());
+                for (auto &kline : klines) {
+                    if (kline.open_time > open_time)
+                        break;
+                    m->last_bar = kline.open_time;
+                    // bars caught up after a gap only update the features
+                    bool complete = m->features.update(kline.close);
+                    m->has_row = complete && kline.open_time == open_time;
+                }
+            });
+        }
+        api.runAsync();
+
+        // rows of the same model next to each other
+        ready.clear();
+        for (auto m : group) {
+            if (m->has_row)
+                ready.push_back(m);
+        }
+        std::stable_sort(ready.begin(), ready.end(), [](const Market *a, const Market *b) {
+            return a->model.get() < b->model.get();
+        });
+        size_t columns = input + 1;
+        rows.resize(ready.size() * columns);
+        scores.resize(ready.size());
+        batches.clear();
+        for (size_t i = 0; i < ready.size(); i++) {
+            ready[i]->features.get(&rows[i * columns]);
+            if (i == 0 || ready[i]->model != ready[i - 1]->model || i - batches.back() == MAX_BATCH)
+                batches.push_back(i);
+        }
+        batches.push_back(ready.size());
+
+        pool.parallel_for(batches.size() - 1, [&](size_t b) {
+            size_t begin = batches[b];
+            size_t end = batches[b + 1];
+            ready[begin]->model->predict_batch(&rows[begin * columns], end - begin, columns, &scores[begin]);
+        });
+
+        if (signal_callback) {
+            for (size_t i = 0; i < ready.size(); i++)
+                signal_callback(ready[i]->symbol, period, scores[i]);
+        }
+    }
+
+private:
+    MexcApi &api;
+    const ModelRegistry &models;
+    const int input;
+    const int inputSma;
+    BarScheduler scheduler;
+    ThreadPool pool;
+    std::vector<std::unique_ptr<Market>> markets;
+    // by period
+    std::map<std::string, std::vector<Market *>> groups;
+    SignalCallback signal_callback;
+    // reused by onClose
+    std::vector<Market *> ready;
+    std::vector<double> rows;
+    std::vector<double> scores;
+    // first row of each model
+    std::vector<size_t> batches;
+};
+
+#endif // MEXC_SERVICE_HPP
@@ -0,0 +1,589 @@
+#ifndef MEXC_STREAM_HPP
+#define MEXC_STREAM_HPP
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <poll.h>
+#include "mexc.hpp"
+#include "mexc_scheduler.hpp"
+
+#define WS_ENDPOINT "wss://wbs.mexc.com/ws"
+
+#define WS_KLINE_CHANNEL "spot@public.kline.v3.api@"
+#define WS_DEALS_CHANNEL "spot@public.deals.v3.api@"
+#define WS_DEPTH_CHANNEL "spot@public.increase.depth.v3.api@"
+
+struct StreamTrade {
+    int64_t time;
+    double price;
+    double qty;
+    // 1: buy, 2: sell
+    int side;
+};
+
+struct StreamDepthLevel {
+    double price;
+    double qty;
+};
+
+// changed levels of a depth update, qty 0 removes a level
+struct StreamDepth {
+    int64_t version;
+    int64_t time;
+    std::vector<StreamDepthLevel> bids;
+    std::vector<StreamDepthLevel> asks;
+};
+
+// WebSocket market data client.
+// poll() (re)connects, resubscribes all channels after a reconnect,
+// keeps the connection alive and calls the callbacks, all on the calling thread.
+//
+// With a MexcApi, bars close on the exchange clock, at the end time of
+// the bar, and bars the stream did not deliver are fetched from REST:
+// those of a quiet symbol without trades, and those of a disconnection,
+// right after resubscribing. Without one, as when replaying, a bar
+// closes when the first update of the next one arrives.
+class MexcStream
+{
+public:
+    // 'bar' is the bar that closed, in klines(); bars closed during a gap
+    // come first, in order, with 'latest' false
+    using BarCloseCallback = std::function<void(const std::string &symbol, const std::string &interval,
+                                                const Kline &bar, bool latest)>;
+    using TradeCallback = std::function<void(const std::string &symbol, const StreamTrade &trade)>;
+    using DepthCallback = std::function<void(const std::string &symbol, const StreamDepth &depth)>;
+    // the depth message as received, for fixed-point decoding
+    using DepthMessageCallback = std::function<void(const std::string &symbol, const std::string &message)>;
+    using CloseCallback = std::function<void()>;
+
+    // 'api' may be NULL, see above
+    explicit MexcStream(std::string url = WS_ENDPOINT, MexcApi *api = NULL) : url{url}, api{api} {
+        if (api)
+            scheduler.reset(new BarScheduler(api));
+        curl = NULL;
+        record_file = NULL;
+        reconnect_delay_ms = 0;
+        next_connect_ms = 0;
+        last_ping_ms = 0;
+        stopped = false;
+    }
+
+    ~MexcStream() {
+        disconnect();
+        if (record_file)
+            fclose(record_file);
+    }
+
+    MexcStream(const MexcStream &) = delete;
+    MexcStream &operator=(const MexcStream &) = delete;
+
+    // keep the last 'capacity' bars of symbol and interval ("1m", "60m", ...)
+    void subscribeKlines(std::string symbol, std::string interval, size_t capacity = 500) {
+        std::string channel = WS_KLINE_CHANNEL + symbol + "@" + wsInterval(interval);
+        KlineBuffer &buffer = kline_buffers[channel];
+        buffer.symbol = symbol;
+        buffer.interval = interval;
+        buffer.capacity = capacity;
+        buffer.last_closed = 0;
+        buffer.stale = false;
+        // intervals without a fixed length (1M) close on the next bar
+        KlineBuffer *b = &buffer;
+        buffer.timed = scheduler && scheduler->add(symbol, interval, [this, b](const std::string &, const std::string &,
+                                                                             int64_t open_time) {
+            closeBars(*b, open_time);
+        });
+        subscribe(channel);
+    }
+
+    void subscribeTrades(std::string symbol) {
+        subscribe(WS_DEALS_CHANNEL + symbol);
+    }
+
+    void subscribeDepth(std::string symbol) {
+        subscribe(WS_DEPTH_CHANNEL + symbol);
+    }
+
+    // fill the kline buffer with bars from MexcApi::getKlines, oldest first
+    void seedKlines(std::string symbol, std::string interval, const Klines &klines) {
+        auto it = kline_buffers.find(WS_KLINE_CHANNEL + symbol + "@" + wsInterval(interval));
+        if (it == kline_buffers.end())
+            return;
+        KlineBuffer &buffer = it->second;
+        buffer.klines.assign(klines.begin(), klines.end());
+        while (buffer.klines.size() > buffer.capacity)
+            buffer.klines.pop_front();
+        // the last bar is taken as still open, the others are not called back
+        buffer.last_closed = buffer.klines.size() > 1 ? buffer.klines[buffer.klines.size() - 2].open_time : 0;
+        buffer.stale = false;
+    }
+
+    const std::deque<Kline> *klines(std::string symbol, std::string interval) const {
+        auto it = kline_buffers.find(WS_KLINE_CHANNEL + symbol + "@" + wsInterval(interval));
+        if (it == kline_buffers.end())
+            return NULL;
+        return &it->second.klines;
+    }
+
+    void onBarClose(BarCloseCallback callback) {
+        bar_close_callback = callback;
+    }
+
+    void onTrade(TradeCallback callback) {
+        trade_callback = callback;
+    }
+
+    void onDepth(DepthCallback callback) {
+        depth_callback = callback;
+    }
+
+    void onDepthMessage(DepthMessageCallback callback) {
+        depth_message_callback = callback;
+    }
+
+    // called when an open connection is closed or lost, before reconnecting
+    void onClose(CloseCallback callback) {
+        close_callback = callback;
+    }
+
+    // append every received data message to 'path', one per line,
+    // for MexcReplayServer
+    bool record(std::string path) {
+        if (record_file)
+            fclose(record_file);
+        record_file = fopen(path.c_str(), "a");
+        return record_file != NULL;
+    }
+
+    bool isConnected() const {
+        return curl != NULL;
+    }
+
+    // wait at most 'timeout_ms' for messages and handle them,
+    // return false if not connected
+    bool poll(int timeout_ms) {
+        int64_t now = nowMs();
+        if (!curl) {
+            if (now < next_connect_ms) {
+                // bars still close, from REST
+                waitFor(-1, std::min<int64_t>(timeout_ms, next_connect_ms - now));
+                return false;
+            }
+            if (!connect()) {
+                // 1 s, 2 s, 4 s ... 30 s
+                reconnect_delay_ms = reconnect_delay_ms ? std::min<int64_t>(reconnect_delay_ms * 2, 30000) : 1000;
+                next_connect_ms = nowMs() + reconnect_delay_ms;
+                return false;
+            }
+            reconnect_delay_ms = 0;
+            // bars changed or closed while disconnected
+            for (auto &buffer : kline_buffers) {
+                if (buffer.second.timed && buffer.second.stale)
+                    backfill(buffer.second);
+            }
+        }
+
+        curl_socket_t sockfd;
+        curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sockfd);
+        // data may already be buffered by TLS, so read once before waiting
+        if (!receive())
+            return false;
+        if (waitFor(sockfd, timeout_ms) && !receive())
+            return false;
+
+        // the server drops connections without a ping for 60 s
+        if (nowMs() - last_ping_ms > 20000) {
+            if (!send("{\"method\":\"PING\"}")) {
+                disconnect();
+                return false;
+            }
+            last_ping_ms = nowMs();
+        }
+        return true;
+    }
+
+    // poll until stop() is called
+    void run() {
+        stopped = false;
+        while (!stopped)
+            poll(1000);
+    }
+
+    // make run() return after the current poll, from a callback or another thread
+    void stop() {
+        stopped = true;
+    }
+
+    // "60m" -> "Min60"
+    static std::string wsInterval(const std::string &interval) {
+        static const char *intervals[][2] = {
+            {"1m", "Min1"}, {"5m", "Min5"}, {"15m", "Min15"}, {"30m", "Min30"}, {"60m", "Min60"},
+            {"4h", "Hour4"}, {"8h", "Hour8"}, {"1d", "Day1"}, {"1W", "Week1"}, {"1M", "Month1"}
+        };
+        for (auto &i : intervals) {
+            if (interval == i[0])
+                return i[1];
+        }
+        return interval;
+    }
+
+private:
+    struct KlineBuffer {
+        std::string symbol;
+        std::string interval;
+        size_t capacity;
+        std::deque<Kline> klines;
+        // closed by the scheduler
+        bool timed;
+        // open time of the last bar called back, 0 if none
+        int64_t last_closed;
+        // updates may have been missed since the last bar called back
+        bool stale;
+    };
+
+    static int64_t nowMs() {
+        return duration_cast<milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void sleepMs(int64_t ms) {
+        if (ms > 0)
+            ::poll(NULL, 0, (int)ms);
+    }
+
+    static double number(const nlohmann::json &value) {
+        if (value.is_string())
+            return std::stod(value.get<std::string>());
+        return value.get<double>();
+    }
+
+    void subscribe(const std::string &channel) {
+        for (auto &c : channels) {
+            if (c == channel)
+                return;
+        }
+        channels.push_back(channel);
+        if (curl && !sendSubscription(channel))
+            disconnect();
+    }
+
+    bool sendSubscription(const std::string &channel) {
+        nlohmann::json message;
+        message["method"] = "SUBSCRIPTION";
+        message["params"] = std::vector<std::string>{channel};
+        return send(message.dump());
+    }
+
+    bool connect() {
+        curl = curl_easy_init();
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 2L);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+        if (curl_easy_perform(curl) != CURLE_OK) {
+            disconnect();
+            return false;
+        }
+
+        message.clear();
+        last_ping_ms = nowMs();
+        for (auto &channel : channels) {
+            if (!sendSubscription(channel)) {
+                disconnect();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (curl) {
+            curl_easy_cleanup(curl);
+            curl = NULL;
+            for (auto &buffer : kline_buffers)
+                buffer.second.stale = true;
+        }
+    }
+
+    // Wait at most 'timeout_ms' for 'sockfd' (-1: none) to be readable and
+    // call the bar closes due meanwhile, return true if 'sockfd' is readable.
+    bool waitFor(curl_socket_t sockfd, int64_t timeout_ms) {
+        struct pollfd pfds[2];
+        nfds_t n = 0;
+        if (sockfd != -1) {
+            pfds[n].fd = sockfd;
+            pfds[n].events = POLLIN;
+            pfds[n++].revents = 0;
+        }
+        if (scheduler) {
+            pfds[n].fd = scheduler->fd();
+            pfds[n].events = POLLIN;
+            pfds[n++].revents = 0;
+        }
+        if (n == 0) {
+            sleepMs(timeout_ms);
+            return false;
+        }
+        if (::poll(pfds, n, (int)timeout_ms) <= 0)
+            return false;
+        if (scheduler && pfds[n - 1].revents)
+            scheduler->poll(0);
+        return sockfd != -1 && pfds[0].revents;
+    }
+
+    // put 'item' in place of the bar of its open time, or after the bars before it
+    static void merge(std::deque<Kline> &klines, const Kline &item) {
+        auto it = klines.end();
+        while (it != klines.begin() && (it - 1)->open_time > item.open_time)
+            --it;
+        if (it != klines.begin() && (it - 1)->open_time == item.open_time)
+            *(it - 1) = item;
+        else
+            klines.insert(it, item);
+    }
+
+    // Fetch the bars after the last one called back, which the stream may
+    // have missed or left incomplete; if none was called back, the latest.
+    void backfill(KlineBuffer &buffer) {
+        Klines bars = api->getKlines(buffer.symbol, buffer.interval,
+                                     buffer.last_closed ? buffer.last_closed + 1 : 0, 0, 1000);
+        if (api->error() != 0)
+            return;
+        for (auto &bar : bars)
+            merge(buffer.klines, bar);
+        while (buffer.klines.size() > buffer.capacity)
+            buffer.klines.pop_front();
+        buffer.stale = false;
+    }
+
+    // The bar opened at 'open_time' closed on the exchange clock: call back
+    // the bars closed since the last one called back, the gap first.
+    // A bar holds the updates received until its close; it is fetched when
+    // there were none or the stream was disconnected.
+    void closeBars(KlineBuffer &buffer, int64_t open_time) {
+        std::deque<Kline> &klines = buffer.klines;
+        bool received = false;
+        for (auto it = klines.rbegin(); it != klines.rend() && it->open_time >= open_time; ++it)
+            received |= it->open_time == open_time;
+        if (buffer.stale || !received)
+            backfill(buffer);
+
+        // nothing before the first close is called back
+        if (buffer.last_closed == 0)
+            buffer.last_closed = open_time - 1;
+        for (size_t i = 0; i < klines.size(); i++) {
+            Kline bar = klines[i];
+            if (bar.open_time <= buffer.last_closed || bar.open_time > open_time)
+                continue;
+            buffer.last_closed = bar.open_time;
+            if (bar_close_callback)
+                bar_close_callback(buffer.symbol, buffer.interval, bar, bar.open_time == open_time);
+        }
+    }
+
+    bool send(const std::string &data) {
+        size_t offset = 0;
+        while (offset < data.size()) {
+            size_t sent = 0;
+            CURLcode res = curl_ws_send(curl, data.data() + offset, data.size() - offset, &sent, 0, CURLWS_TEXT);
+            if (res == CURLE_AGAIN) {
+                sleepMs(1);
+                continue;
+            }
+            if (res != CURLE_OK)
+                return false;
+            offset += sent;
+        }
+        return true;
+    }
+
+    // read all available frames, return false on disconnection
+    bool receive() {
+        char buffer[65536];
+        for (;;) {
+            size_t n = 0;
+            const struct curl_ws_frame *meta = NULL;
+            CURLcode res = curl_ws_recv(curl, buffer, sizeof(buffer), &n, &meta);
+            if (res == CURLE_AGAIN)
+                return true;
+            if (res != CURLE_OK || (meta->flags & CURLWS_CLOSE)) {
+                disconnect();
+                next_connect_ms = nowMs() + 1000;
+                if (close_callback)
+                    close_callback();
+                return false;
+            }
+            if (!(meta->flags & (CURLWS_TEXT | CURLWS_BINARY)))
+                continue;
+
+            message.append(buffer, n);
+            if (meta->bytesleft == 0 && !(meta->flags & CURLWS_CONT)) {
+                // a callback may throw, the next message starts empty anyway
+                message.swap(complete_message);
+                message.clear();
+                handleMessage(complete_message);
+            }
+        }
+    }
+
+    void handleMessage(const std::string &data) {
+        nlohmann::json result = nlohmann::json::parse(data, nullptr, false);
+        if (result.is_discarded() || !result.is_object())
+            return;
+        auto c = result.find("c");
+        auto d = result.find("d");
+        if (c == result.end() || d == result.end() || !c->is_string())
+            return;
+
+        if (record_file) {
+            fprintf(record_file, "%s\n", data.c_str());
+            fflush(record_file);
+        }
+
+        const std::string &channel = c->get_ref<const std::string &>();
+        auto s = result.find("s");
+        std::string symbol = s != result.end() && s->is_string() ? s->get<std::string>() : std::string();
+        if (channel.compare(0, strlen(WS_KLINE_CHANNEL), WS_KLINE_CHANNEL) == 0) {
+            auto k = d->find("k");
+            if (k != d->end())
+                handleKline(channel, *k);
+        }
+        else if (channel.compare(0, strlen(WS_DEALS_CHANNEL), WS_DEALS_CHANNEL) == 0) {
+            handleDeals(symbol, *d);
+        }
+        else if (channel.compare(0, strlen(WS_DEPTH_CHANNEL), WS_DEPTH_CHANNEL) == 0) {
+            if (depth_message_callback)
+                depth_message_callback(symbol, data);
+            auto t = result.find("t");
+            handleDepth(symbol, *d, t != result.end() && t->is_number_integer() ? t->get<int64_t>() : 0);
+        }
+    }
+
+    // Fields of messages, false if one is missing or of another type:
+    // such a message is dropped. Callbacks are called outside, so their
+    // exceptions reach the caller of poll().
+    static bool readKline(const nlohmann::json &k, Kline &item) {
+        try {
+            // times are in seconds, the end time is exclusive
+            item.open_time = k.at("t").get<int64_t>() * 1000;
+            item.open = number(k.at("o"));
+            item.high = number(k.at("h"));
+            item.low = number(k.at("l"));
+            item.close = number(k.at("c"));
+            item.volume = number(k.at("v"));
+            item.close_time = k.at("T").get<int64_t>() * 1000 - 1;
+            item.quote_asset_volume = number(k.at("a"));
+            return true;
+        }
+        catch (const std::exception &) {
+            return false;
+        }
+    }
+
+    static bool readTrades(const nlohmann::json &d, std::vector<StreamTrade> &res) {
+        res.clear();
+        try {
+            for (auto &deal : d.at("deals")) {
+                StreamTrade trade;
+                trade.time = deal.at("t").get<int64_t>();
+                trade.price = number(deal.at("p"));
+                trade.qty = number(deal.at("v"));
+                trade.side = deal.at("S").get<int>();
+                res.push_back(trade);
+            }
+            return true;
+        }
+        catch (const std::exception &) {
+            return false;
+        }
+    }
+
+    static bool readDepth(const nlohmann::json &d, int64_t time, StreamDepth &res) {
+        try {
+            res.version = 0;
+            if (d.contains("r"))
+                res.version = d.at("r").is_string() ? std::stoll(d.at("r").get<std::string>()) : d.at("r").get<int64_t>();
+            res.time = time;
+            if (d.contains("bids")) {
+                for (auto &level : d.at("bids"))
+                    res.bids.push_back({number(level.at("p")), number(level.at("v"))});
+            }
+            if (d.contains("asks")) {
+                for (auto &level : d.at("asks"))
+                    res.asks.push_back({number(level.at("p")), number(level.at("v"))});
+            }
+            return true;
+        }
+        catch (const std::exception &) {
+            return false;
+        }
+    }
+
+    void handleKline(const std::string &channel, const nlohmann::json &k) {
+        auto it = kline_buffers.find(channel);
+        if (it == kline_buffers.end() || !k.is_object())
+            return;
+        KlineBuffer &buffer = it->second;
+        Kline item;
+        if (!readKline(k, item))
+            return;
+
+        std::deque<Kline> &klines = buffer.klines;
+        if (!klines.empty() && item.open_time < klines.back().open_time)
+            return;
+        if (!klines.empty() && item.open_time == klines.back().open_time) {
+            klines.back() = item;
+            return;
+        }
+
+        // without the scheduler, the first update of a new bar closes the last one
+        if (!buffer.timed && !klines.empty() && bar_close_callback)
+            bar_close_callback(buffer.symbol, buffer.interval, klines.back(), true);
+        klines.push_back(item);
+        while (klines.size() > buffer.capacity)
+            klines.pop_front();
+    }
+
+    void handleDeals(const std::string &symbol, const nlohmann::json &d) {
+        if (!trade_callback || !d.contains("deals") || !readTrades(d, trades))
+            return;
+        for (auto &trade : trades)
+            trade_callback(symbol, trade);
+    }
+
+    void handleDepth(const std::string &symbol, const nlohmann::json &d, int64_t time) {
+        if (!depth_callback)
+            return;
+        StreamDepth depth;
+        if (readDepth(d, time, depth))
+            depth_callback(symbol, depth);
+    }
+
+private:
+    const std::string url;
+    MexcApi *api;
+    // closes the bars when there is an api
+    std::unique_ptr<BarScheduler> scheduler;
+    CURL *curl;
+    std::vector<std::string> channels;
+    // by kline channel
+    std::map<std::string, KlineBuffer> kline_buffers;
+    BarCloseCallback bar_close_callback;
+    TradeCallback trade_callback;
+    DepthCallback depth_callback;
+    DepthMessageCallback depth_message_callback;
+    CloseCallback close_callback;
+    // a message split over several frames, and the last complete one
+    std::string message;
+    std::string complete_message;
+    // of a deals message
+    std::vector<StreamTrade> trades;
+    FILE *record_file;
+    int64_t reconnect_delay_ms;
+    int64_t next_connect_ms;
+    int64_t last_ping_ms;
+    std::atomic<bool> stopped;
+};
+
+#endif // MEXC_STREAM_HPP
@@ -0,0 +1,271 @@
+#ifndef MEXC_STUB_SERVER_HPP
+#define MEXC_STUB_SERVER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// Local HTTP server answering REST requests with canned bodies, for
+// running MexcApi without the exchange: MexcApi("", "", server.url()).
+// Each connection is served on its own thread and kept alive, as curl
+// reuses them. Every response is delayed by 'delay_ms', so requests that
+// overlap show in maxConcurrent(), and throttle() answers the next
+// requests with 429, to check that they are retried.
+class MexcStubServer
+{
+public:
+    explicit MexcStubServer(int delay_ms = 0) : delay_ms{delay_ms} {
+        listen_fd = -1;
+        listen_port = 0;
+        stopping = false;
+        to_throttle = 0;
+        retry_after = 1;
+        request_count = 0;
+        throttled_count = 0;
+        concurrent = 0;
+        max_concurrent = 0;
+        // MexcApi pings when it is constructed
+        route("/api/v3/ping", "{}");
+    }
+
+    ~MexcStubServer() {
+        stop();
+    }
+
+    MexcStubServer(const MexcStubServer &) = delete;
+    MexcStubServer &operator=(const MexcStubServer &) = delete;
+
+    // answer requests of 'path', without the query, with 'body';
+    // others get 404
+    void route(std::string path, std::string body) {
+        std::lock_guard<std::mutex> lock(mutex);
+        routes[path] = body;
+    }
+
+    // answer the next 'n' requests 429 with Retry-After 'seconds'
+    void throttle(int n, int seconds = 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        to_throttle = n;
+        retry_after = seconds;
+    }
+
+    // listen on 127.0.0.1:port (0: any free port), return false on failure
+    bool start(int port = 0) {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd == -1)
+            return false;
+        int on = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        socklen_t len = sizeof(addr);
+        if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+                || listen(listen_fd, 64) == -1
+                || getsockname(listen_fd, (struct sockaddr *)&addr, &len) == -1) {
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        listen_port = ntohs(addr.sin_port);
+
+        thread = std::thread([this] { serve(); });
+        return true;
+    }
+
+    void stop() {
+        stopping = true;
+        if (thread.joinable())
+            thread.join();
+        for (auto &t : connections) {
+            if (t.joinable())
+                t.join();
+        }
+        connections.clear();
+        if (listen_fd != -1) {
+            close(listen_fd);
+            listen_fd = -1;
+        }
+    }
+
+    int port() const {
+        return listen_port;
+    }
+
+    std::string url() const {
+        return "http://127.0.0.1:" + std::to_string(listen_port);
+    }
+
+    // requests received, 429 included
+    size_t requests() const {
+        return request_count;
+    }
+
+    size_t throttled() const {
+        return throttled_count;
+    }
+
+    // most requests being answered at once
+    int maxConcurrent() const {
+        return max_concurrent;
+    }
+
+private:
+    // wait until 'fd' is readable or stop() is called
+    bool waitReadable(int fd) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        while (!stopping) {
+            pfd.revents = 0;
+            if (::poll(&pfd, 1, 100) > 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool writeFully(int fd, const void *data, size_t size) {
+        const char *p = (const char *)data;
+        while (size) {
+            ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // read the next request of the connection, its path to 'path';
+    // 'input' keeps what was read after it
+    bool readRequest(int fd, std::string &input, std::string &path) {
+        size_t end;
+        while ((end = input.find("\r\n\r\n")) == std::string::npos) {
+            if (input.size() > 65536 || !waitReadable(fd))
+                return false;
+            char buffer[4096];
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0)
+                return false;
+            input.append(buffer, n);
+        }
+
+        // "GET /api/v3/klines?symbol=... HTTP/1.1"
+        size_t begin = input.find(' ');
+        if (begin == std::string::npos || begin > end)
+            return false;
+        size_t path_end = input.find_first_of(" ?", begin + 1);
+        path = input.substr(begin + 1, path_end - begin - 1);
+
+        // orders carry a body
+        size_t body_size = 0;
+        std::string headers = input.substr(0, end);
+        for (auto &ch : headers)
+            ch = tolower(ch);
+        size_t length = headers.find("\r\ncontent-length:");
+        if (length != std::string::npos)
+            body_size = strtoul(headers.c_str() + length + 17, NULL, 10);
+        while (input.size() < end + 4 + body_size) {
+            if (!waitReadable(fd))
+                return false;
+            char buffer[4096];
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0)
+                return false;
+            input.append(buffer, n);
+        }
+        input.erase(0, end + 4 + body_size);
+        return true;
+    }
+
+    bool respond(int fd, const std::string &path) {
+        request_count++;
+        int now = ++concurrent;
+        int max = max_concurrent;
+        while (now > max && !max_concurrent.compare_exchange_weak(max, now)) {
+        }
+        if (delay_ms)
+            usleep(delay_ms * 1000);
+
+        std::string status = "200 OK";
+        std::string body;
+        std::string extra;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = routes.find(path);
+            if (to_throttle > 0) {
+                to_throttle--;
+                throttled_count++;
+                status = "429 Too Many Requests";
+                body = "{\"code\":429,\"msg\":\"Too Many Requests\"}";
+                extra = "Retry-After: " + std::to_string(retry_after) + "\r\n";
+            }
+            else if (it != routes.end()) {
+                body = it->second;
+            }
+            else {
+                status = "404 Not Found";
+                body = "{\"code\":404,\"msg\":\"Not Found\"}";
+            }
+        }
+
+        std::string response = "HTTP/1.1 " + status + "\r\n"
+                                "Content-Type: application/json\r\n"
+                                "Content-Length: " + std::to_string(body.size()) + "\r\n" + extra + "\r\n" + body;
+        concurrent--;
+        return writeFully(fd, response.data(), response.size());
+    }
+
+    void serveConnection(int fd) {
+        std::string input;
+        std::string path;
+        while (!stopping && readRequest(fd, input, path) && respond(fd, path)) {
+        }
+        close(fd);
+    }
+
+    void serve() {
+        while (!stopping) {
+            if (!waitReadable(listen_fd))
+                break;
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd == -1)
+                continue;
+            connections.emplace_back([this, fd] { serveConnection(fd); });
+        }
+    }
+
+private:
+    const int delay_ms;
+    int listen_fd;
+    int listen_port;
+    std::atomic<bool> stopping;
+    std::thread thread;
+    // of the accepted connections, joined by stop()
+    std::vector<std::thread> connections;
+    std::mutex mutex;
+    // by path
+    std::map<std::string, std::string> routes;
+    int to_throttle;
+    int retry_after;
+    std::atomic<size_t> request_count;
+    std::atomic<size_t> throttled_count;
+    std::atomic<int> concurrent;
+    std::atomic<int> max_concurrent;
+};
+
+#endif // MEXC_STUB_SERVER_HPP
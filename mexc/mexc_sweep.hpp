@@ -0,0 +1,173 @@
+#ifndef MEXC_SWEEP_HPP
+#define MEXC_SWEEP_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include "../gbdt/gbdt.h"
+#include "../gbdt/thread-pool.h"
+
+struct SweepResult {
+    TreeParam param;
+    // mean over the folds of the validation samples
+    double loss;
+    // share of validation samples whose prediction has the sign of y
+    double hit_rate;
+    // of training and validating all folds, on one thread each
+    double seconds;
+};
+
+// Walk-forward cross-validation of many GBDTTrainer configurations over one
+// training set, in time order. Fold k trains on the samples before its
+// validation block and validates on the block, so no model sees the
+// samples it is validated on, nor later ones.
+//
+// The set is binned once (by limit_x_values if histograms are used) and
+// only read afterwards: every trainer trains on a prefix of it, and all
+// (configuration, fold) pairs run concurrently on one pool, one thread
+// each, the most expensive first.
+class WalkForward
+{
+public:
+    // 'rows' are the samples of 'set' row-major, 'columns' each, to predict
+    // the validation blocks in batches; samples of the last 'gap' before a
+    // block are not trained on, their y looking into it; the first fold
+    // trains on a 1 / (folds + 1) of the samples
+    WalkForward(const XYSet &set, const double *rows, size_t columns, size_t folds, size_t gap, size_t threads)
+        : set{set}, rows{rows}, columns{columns}, folds{std::max<size_t>(folds, 1)}, gap{gap}, pool{threads} {
+    }
+
+    WalkForward(const WalkForward &) = delete;
+    WalkForward &operator=(const WalkForward &) = delete;
+
+    // results of every configuration, best (lowest loss) first;
+    // gbdt_histogram_bins must be those the set was limited to by limit_x_values
+    std::vector<SweepResult> run(const std::vector<TreeParam> &params) {
+        for (auto &param : params) {
+            if (param.gbdt_histogram_bins && !x_values_limited(set, param.gbdt_histogram_bins)) {
+                fprintf(stderr, "x values are not limited to %zu for histograms\n", param.gbdt_histogram_bins);
+                return {};
+            }
+        }
+        size_t block = set.size() / (folds + 1);
+        std::vector<Job> jobs;
+        for (size_t i = 0; i < params.size(); i++) {
+            for (size_t k = 0; k < folds; k++) {
+                Job job;
+                job.param = i;
+                job.begin = block * (k + 1);
+                job.end = k + 1 == folds ? set.size() : job.begin + block;
+                job.train_size = job.begin > gap ? job.begin - gap : 0;
+                if (job.train_size > 0 && job.end > job.begin)
+                    jobs.push_back(job);
+            }
+        }
+        std::stable_sort(jobs.begin(), jobs.end(), [&](const Job &a, const Job &b) {
+            return (double)params[a.param].tree_number * a.train_size >
+                   (double)params[b.param].tree_number * b.train_size;
+        });
+
+        pool.parallel_for(jobs.size(), [&](size_t j) {
+            runJob(params[jobs[j].param], &jobs[j]);
+        });
+
+        std::vector<SweepResult> results(params.size());
+        std::vector<size_t> samples(params.size(), 0);
+        std::vector<size_t> done(params.size(), 0);
+        for (size_t i = 0; i < params.size(); i++) {
+            results[i].param = params[i];
+            results[i].loss = 0;
+            results[i].hit_rate = 0;
+            results[i].seconds = 0;
+        }
+        for (auto &job : jobs) {
+            SweepResult &result = results[job.param];
+            result.loss += job.loss;
+            result.hit_rate += job.hits;
+            result.seconds += job.seconds;
+            samples[job.param] += job.end - job.begin;
+            done[job.param]++;
+        }
+        for (size_t i = 0; i < params.size(); i++) {
+            results[i].loss = done[i] ? results[i].loss / done[i] : INFINITY;
+            results[i].hit_rate = samples[i] ? results[i].hit_rate / samples[i] : 0;
+        }
+        std::stable_sort(results.begin(), results.end(), [](const SweepResult &a, const SweepResult &b) {
+            return a.loss < b.loss;
+        });
+        return results;
+    }
+
+    // 'n' configurations around 'base', drawn from the ranges main.cpp's
+    // defaults sit in, the learning rate log-uniformly
+    static std::vector<TreeParam> randomParams(const TreeParam &base, size_t n, unsigned seed) {
+        std::vector<TreeParam> params(n, base);
+        for (auto &param : params) {
+            param.max_level = 3 + rand_r(&seed) % 6;
+            param.max_leaf_number = 8 + rand_r(&seed) % 57;
+            param.min_values_in_leaf = 5 + rand_r(&seed) % 96;
+            param.tree_number = 50 + rand_r(&seed) % 951;
+            param.learning_rate = exp(log(0.005) + (log(0.3) - log(0.005)) * rand_r(&seed) / RAND_MAX);
+        }
+        return params;
+    }
+
+    static void printLeaderboard(const std::vector<SweepResult> &results, size_t top) {
+        printf("rank     loss  hit rate  max_level  max_leaf_number  min_values_in_leaf  tree_number  learning_rate  seconds\n");
+        for (size_t i = 0; i < results.size() && i < top; i++) {
+            const SweepResult &r = results[i];
+            printf("%4zu %8.5lf %8.2lf%% %10zu %16zu %19zu %12zu %14.5lf %8.2lf\n", i + 1, r.loss, r.hit_rate * 100,
+                   r.param.max_level, r.param.max_leaf_number, r.param.min_values_in_leaf, r.param.tree_number,
+                   r.param.learning_rate, r.seconds);
+        }
+    }
+
+private:
+    struct Job {
+        // index in the configurations
+        size_t param;
+        // validation samples
+        size_t begin;
+        size_t end;
+        size_t train_size;
+        // mean squared error
+        double loss;
+        // samples of the right sign
+        size_t hits;
+        double seconds;
+    };
+
+    void runJob(TreeParam param, Job *job) const {
+        auto start = std::chrono::steady_clock::now();
+        // configurations run in parallel instead
+        param.num_threads = 1;
+        param.verbose = 0;
+        GBDTTrainer trainer(set, param, job->train_size);
+        trainer.train();
+
+        size_t n = job->end - job->begin;
+        std::vector<double> predicted(n);
+        trainer.predict_batch(rows + job->begin * columns, n, columns, predicted.data());
+        double loss = 0;
+        size_t hits = 0;
+        for (size_t i = 0; i < n; i++) {
+            double y = set.y(job->begin + i);
+            loss += (predicted[i] - y) * (predicted[i] - y);
+            hits += (predicted[i] > 0) == (y > 0);
+        }
+        job->loss = loss / n;
+        job->hits = hits;
+        job->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    const XYSet &set;
+    const double *rows;
+    const size_t columns;
+    const size_t folds;
+    const size_t gap;
+    ThreadPool pool;
+};
+
+#endif // MEXC_SWEEP_HPP